@@ -0,0 +1,116 @@
+// bench_buffer.cpp - Load time and per-keystroke latency of TextBuffer backends
+// Compile: g++ -O2 -o bench_buffer bench_buffer.cpp ../src/Buffer.cpp ../src/PieceTable.cpp ../src/Rope.cpp ../src/MappedFile.cpp ../src/UndoSpill.cpp ../src/SimdScan.cpp ../src/TrigramIndex.cpp -std=c++11 -I../include
+// Run: ./bench_buffer
+
+#include "Buffer.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+using namespace std::chrono;
+
+const int KEYSTROKES = 2000;
+
+// Build a document of the requested size out of short text lines
+string makeDocument(size_t size) {
+    const string line = "The quick brown fox jumps over the lazy dog 0123456789\n";
+    string text;
+    text.reserve(size);
+    while (text.length() < size) {
+        text += line;
+    }
+    text.resize(size);
+    return text;
+}
+
+string formatSize(size_t bytes) {
+    if (bytes >= 1024 * 1024) return to_string(bytes / (1024 * 1024)) + " MB";
+    if (bytes >= 1024) return to_string(bytes / 1024) + " KB";
+    return to_string(bytes) + " B";
+}
+
+string backendName(BufferBackend backend) {
+    switch (backend) {
+        case BufferBackend::PieceTable: return "piece table";
+        case BufferBackend::Rope: return "rope";
+        default: return "chunked";
+    }
+}
+
+// Load the document, type KEYSTROKES characters at a cursor in the middle,
+// delete them again one backspace at a time, then read short substrings
+// the way DeleteCommand and ReplaceCommand do
+void benchmarkSize(BufferBackend backend, size_t size) {
+    string document = makeDocument(size);
+    
+    auto loadStart = steady_clock::now();
+    TextBuffer buffer(document, backend);
+    auto start = steady_clock::now();
+    
+    size_t cursor = size / 2;
+    for (int i = 0; i < KEYSTROKES; i++) {
+        buffer.insert(cursor++, string(1, 'a' + i % 26));
+    }
+    auto mid = steady_clock::now();
+    for (int i = 0; i < KEYSTROKES; i++) {
+        buffer.deleteText(--cursor, 1);
+    }
+    auto end = steady_clock::now();
+    
+    size_t checksum = 0;
+    for (int i = 0; i < KEYSTROKES; i++) {
+        checksum += buffer.getSubstring((i * 7919) % size, 10).length();
+    }
+    auto readEnd = steady_clock::now();
+    
+    double loadMs = duration_cast<microseconds>(start - loadStart).count() / 1000.0;
+    double insertNs = duration_cast<nanoseconds>(mid - start).count() / (double)KEYSTROKES;
+    double deleteNs = duration_cast<nanoseconds>(end - mid).count() / (double)KEYSTROKES;
+    double substrNs = duration_cast<nanoseconds>(readEnd - end).count() / (double)KEYSTROKES;
+    
+    cout << setw(12) << backendName(backend) << " | "
+         << setw(10) << formatSize(size) << " | "
+         << setw(10) << fixed << setprecision(2) << loadMs << " | "
+         << setw(14) << setprecision(1) << insertNs << " | "
+         << setw(14) << deleteNs << " | "
+         << setw(14) << substrNs << endl;
+    
+    if (buffer.length() != size || checksum == 0) {
+        cout << "[ERROR] Buffer length mismatch after benchmark!" << endl;
+        exit(1);
+    }
+}
+
+int main() {
+    cout << "=======================================" << endl;
+    cout << "   TEXT BUFFER KEYSTROKE BENCHMARK" << endl;
+    cout << "=======================================" << endl << endl;
+    
+    cout << setw(12) << "Backend" << " | "
+         << setw(10) << "Document" << " | "
+         << setw(10) << "load ms" << " | "
+         << setw(14) << "insert ns/op" << " | "
+         << setw(14) << "delete ns/op" << " | "
+         << setw(14) << "substr ns/op" << endl;
+    cout << string(89, '-') << endl;
+    
+    size_t sizes[] = {
+        1024, 10 * 1024, 100 * 1024,
+        1024 * 1024, 10 * 1024 * 1024, 100 * 1024 * 1024
+    };
+    
+    BufferBackend backends[] = {
+        BufferBackend::Chunked, BufferBackend::PieceTable, BufferBackend::Rope
+    };
+    
+    for (BufferBackend backend : backends) {
+        for (size_t size : sizes) {
+            benchmarkSize(backend, size);
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,189 @@
+// bench_search.cpp - Substring search throughput: old Rabin-Karp loop vs the SIMD prefilter
+// Compile: g++ -O2 -o bench_search bench_search.cpp ../src/SimdScan.cpp ../src/Buffer.cpp ../src/PieceTable.cpp ../src/Rope.cpp ../src/MappedFile.cpp ../src/UndoSpill.cpp ../src/TrigramIndex.cpp -std=c++11 -I../include
+// Run: ./bench_search ../data/*.txt
+
+#include "SimdScan.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cctype>
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t MIN_SCAN_BYTES = 16 * 1024 * 1024;  // small files are repeated up to this
+const long long PRIME = 1000000007;
+const int BASE = 256;
+
+// The search as it was before the prefilter: hash every window, then
+// compare through a substr copy on each hash hit
+vector<size_t> rollingHashBaseline(const string& text, const string& pattern) {
+    vector<size_t> positions;
+    if (pattern.empty() || pattern.length() > text.length()) {
+        return positions;
+    }
+    
+    size_t m = pattern.length();
+    long long patternHash = 0, textHash = 0, pow = 1;
+    for (size_t i = 0; i < m; i++) {
+        patternHash = (patternHash * BASE + (unsigned char)pattern[i]) % PRIME;
+        textHash = (textHash * BASE + (unsigned char)text[i]) % PRIME;
+        if (i > 0) pow = (pow * BASE) % PRIME;
+    }
+    
+    for (size_t i = 0; i <= text.length() - m; i++) {
+        if (textHash == patternHash && text.substr(i, m) == pattern) {
+            positions.push_back(i);
+        }
+        if (i < text.length() - m) {
+            textHash = (textHash - ((unsigned char)text[i] * pow) % PRIME + PRIME) % PRIME;
+            textHash = (textHash * BASE + (unsigned char)text[i + m]) % PRIME;
+        }
+    }
+    return positions;
+}
+
+string toLower(const string& text) {
+    string lowered = text;
+    for (char& c : lowered) {
+        c = tolower((unsigned char)c);
+    }
+    return lowered;
+}
+
+string makeDocument() {
+    const string line = "The quick brown fox jumps over the lazy dog 0123456789\n";
+    string text;
+    while (text.length() < MIN_SCAN_BYTES) {
+        text += line;
+    }
+    return text;
+}
+
+bool readFile(const string& path, string& text) {
+    ifstream file(path, ios::binary);
+    if (!file) return false;
+    stringstream contents;
+    contents << file.rdbuf();
+    text = contents.str();
+    return true;
+}
+
+// First word of the text (at most 8 bytes) and one that never occurs
+vector<string> pickPatterns(const string& text) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    size_t end = text.find_first_of(" \t\r\n", start);
+    vector<string> patterns;
+    if (start != string::npos) {
+        patterns.push_back(text.substr(start, min<size_t>(8, end - start)));
+    }
+    patterns.push_back("#not-in-this-text#");
+    return patterns;
+}
+
+template <typename Search>
+double throughput(const string& text, Search search, size_t& matches) {
+    auto start = steady_clock::now();
+    matches = search();
+    double seconds = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+    return text.length() / seconds / (1024.0 * 1024.0);
+}
+
+void benchmarkText(const string& name, const string& sample) {
+    string text = sample;
+    while (text.length() < MIN_SCAN_BYTES) {
+        text += sample;
+    }
+    
+    for (const string& pattern : pickPatterns(sample)) {
+        size_t expected;
+        double baseline = throughput(text, [&]() { return rollingHashBaseline(text, pattern).size(); }, expected);
+        
+        cout << setw(20) << name.substr(0, 20) << " | "
+             << setw(18) << ("\"" + pattern + "\"").substr(0, 18) << " | "
+             << setw(11) << "rolling" << " | "
+             << setw(10) << fixed << setprecision(0) << baseline << " | "
+             << setw(8) << expected << endl;
+        
+        SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2};
+        for (SimdLevel level : levels) {
+            if (level > detectSimdLevel()) continue;
+            
+            size_t matches;
+            double rate = throughput(text, [&]() {
+                vector<size_t> positions;
+                findOccurrences(text.data(), text.length(), pattern, positions, 0, level);
+                return positions.size();
+            }, matches);
+            
+            cout << setw(20) << "" << " | "
+                 << setw(18) << "" << " | "
+                 << setw(11) << simdLevelName(level) << " | "
+                 << setw(10) << rate << " | "
+                 << setw(8) << matches
+                 << (matches != expected ? "  [MISMATCH]" : "") << endl;
+        }
+        
+        // Case-insensitive: the old way lowercased copies of text and
+        // pattern first; the fold now happens inside the scan
+        size_t foldedExpected;
+        double lowered = throughput(text, [&]() {
+            return rollingHashBaseline(toLower(text), toLower(pattern)).size();
+        }, foldedExpected);
+        cout << setw(20) << "" << " | "
+             << setw(18) << "" << " | "
+             << setw(11) << "copy+lower" << " | "
+             << setw(10) << lowered << " | "
+             << setw(8) << foldedExpected << endl;
+        
+        for (SimdLevel level : levels) {
+            if (level > detectSimdLevel()) continue;
+            
+            size_t matches;
+            double rate = throughput(text, [&]() {
+                vector<size_t> positions;
+                findOccurrencesIgnoreCase(text.data(), text.length(), pattern, positions, 0, level);
+                return positions.size();
+            }, matches);
+            
+            cout << setw(20) << "" << " | "
+                 << setw(18) << "" << " | "
+                 << setw(11) << (string(simdLevelName(level)) + " fold") << " | "
+                 << setw(10) << rate << " | "
+                 << setw(8) << matches
+                 << (matches != foldedExpected ? "  [MISMATCH]" : "") << endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    cout << "=======================================" << endl;
+    cout << "   SUBSTRING SEARCH BENCHMARK" << endl;
+    cout << "=======================================" << endl;
+    cout << "CPU support: " << simdLevelName(SimdLevel::Best) << endl << endl;
+    
+    cout << setw(20) << "Input" << " | "
+         << setw(18) << "Pattern" << " | "
+         << setw(11) << "Method" << " | "
+         << setw(10) << "MB/s" << " | "
+         << setw(8) << "Matches" << endl;
+    cout << string(80, '-') << endl;
+    
+    if (argc < 2) {
+        benchmarkText("generated", makeDocument());
+    }
+    for (int i = 1; i < argc; i++) {
+        string text;
+        if (!readFile(argv[i], text) || text.empty()) {
+            cout << "[SKIP] " << argv[i] << " is missing or empty" << endl;
+            continue;
+        }
+        benchmarkText(argv[i], text);
+    }
+    
+    return 0;
+}
@@ -4,6 +4,14 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <utility>
+#include "Buffer.h"
+#include "RegexEngine.h"
+#include "SuffixArray.h"
+#include "TrigramIndex.h"
+#include "ThreadPool.h"
+#include <map>
+#include <cstdint>
 
 using namespace std;
 
@@ -13,9 +21,21 @@ struct SearchResult {
     size_t line;
     size_t column;
     string context;  // Surrounding text
+    size_t length;        // of the matched text
+    size_t patternIndex;  // which pattern matched (multi-pattern search)
+    int distance;         // edits between the pattern and the match (fuzzy search)
     
-    SearchResult(size_t pos, size_t ln, size_t col, const string& ctx)
-        : position(pos), line(ln), column(col), context(ctx) {}
+    SearchResult(size_t pos, size_t ln, size_t col, const string& ctx, size_t len = 0, size_t patternIdx = 0)
+        : position(pos), line(ln), column(col), context(ctx), length(len), patternIndex(patternIdx),
+          distance(0) {}
+};
+
+// Matches in one file of a directory search
+struct FileSearchResult {
+    string path;
+    vector<SearchResult> results;
+    
+    FileSearchResult(const string& p) : path(p) {}
 };
 
 // Search options/flags
@@ -25,50 +45,311 @@ struct SearchOptions {
     bool useRegex;
     bool searchBackward;
     int contextLines;  // Number of lines to show before/after match
+    unsigned int threads;  // 1 = single-threaded, 0 = one per core
+    size_t maxResults;     // stop after this many results, 0 = no limit
     
     SearchOptions() 
         : caseSensitive(true), wholeWord(false), useRegex(false),
-          searchBackward(false), contextLines(1) {}
+          searchBackward(false), contextLines(1), threads(1), maxResults(0) {}
+};
+
+class AdvancedSearchEngine;
+
+// Results of one buffer search, produced on demand (see
+// AdvancedSearchEngine::openSearch). An exact pattern is scanned a block at
+// a time, only as far as the results asked for, so the first page costs the
+// same however many matches follow; a regular expression is matched in one
+// pass up front. Line and column are resolved as each result is returned,
+// the context only through getContext(). The cursor reads the buffer in
+// place: the buffer and engine must outlive it, and after an edit
+// isValid() is false and it returns nothing more.
+class SearchCursor {
+private:
+    const AdvancedSearchEngine* engine;
+    const TextBuffer* buffer;
+    uint64_t version;
+    BufferView view;
+    string pattern;
+    SearchOptions options;
+    shared_ptr<Regex> regex;  // null for an exact pattern
+    
+    vector<Regex::Match> pending;  // found but not yet returned, in search order
+    size_t pendingNext;
+    size_t scanned;  // exact: the scan has covered text before (backward: after) this
+    bool exhausted;
+    size_t returned;
+    
+    static const size_t BLOCK_SIZE = 64 << 10;
+    
+    bool refill();  // false once the text is used up
+    
+public:
+    SearchCursor(const AdvancedSearchEngine* eng, const TextBuffer& buf, const string& pat,
+                 const SearchOptions& opts, shared_ptr<Regex> compiled);
+    
+    // Next match in search order (last to first with searchBackward), with
+    // an empty context. False when there are no more, maxResults have been
+    // returned, or the buffer has changed.
+    bool next(SearchResult& result);
+    vector<SearchResult> nextPage(size_t count);
+    
+    // options.contextLines lines around a returned result
+    string getContext(const SearchResult& result) const;
+    
+    bool isValid() const { return buffer->getVersion() == version; }
+    size_t getReturnedCount() const { return returned; }
+};
+
+// Aho-Corasick automaton for matching many patterns in one pass. All
+// transitions live in one flat table indexed by state * alphabetSize + class,
+// where bytes that occur in no pattern share class 0 (case folding is done
+// in the same byte -> class map), so the table stays small.
+class AhoCorasick {
+public:
+    struct Match {
+        size_t position;  // first character of the match
+        size_t patternIndex;
+        
+        Match(size_t pos, size_t idx) : position(pos), patternIndex(idx) {}
+    };
+
+private:
+    unsigned short byteClass[256];
+    size_t alphabetSize;
+    vector<int> transitions;
+    vector<int> outputLink;         // nearest state on the fail chain with patterns, or -1
+    vector<size_t> outputStart;     // patterns ending at state s: outputs[outputStart[s] .. outputStart[s + 1])
+    vector<size_t> outputs;
+    vector<size_t> patternLengths;
+
+public:
+    explicit AhoCorasick(const vector<string>& patterns, bool caseSensitive = true);
+    
+    // Runs length bytes through the automaton starting from state and
+    // returns the state reached; text may be fed in pieces this way.
+    // Match positions are offset by base.
+    int scan(const char* data, size_t length, int state, size_t base, vector<Match>& matches) const;
+    
+    size_t getStateCount() const { return outputLink.size(); }
+    size_t getPatternCount() const { return patternLengths.size(); }
+};
+
+// Myers' bit-vector edit distance: one column of the dynamic programming
+// matrix is kept as bit vectors of +1/-1 vertical deltas, 64 pattern
+// characters per word, so each text byte costs a few word operations per
+// 64 characters of pattern. Longer patterns use several words with the
+// horizontal delta carried from one word to the next.
+class MyersMatcher {
+private:
+    size_t patternLength;
+    size_t wordCount;
+    vector<uint64_t> peq;  // 256 * wordCount: bit i set where pattern[i] matches the byte
+    vector<uint64_t> pv;   // +1 vertical deltas
+    vector<uint64_t> mv;   // -1 vertical deltas
+    uint64_t lastBit;      // pattern's last row within the last word
+    int score;
+    bool anchored;
+
+public:
+    explicit MyersMatcher(const string& pattern, bool caseSensitive = true);
+    
+    // Anchored: the match must start at the first byte fed (plain edit
+    // distance). Otherwise it may start anywhere (searching).
+    void reset(bool anchoredStart);
+    
+    // Feeds length bytes; for every byte after which the pattern matches
+    // with at most maxDistance edits, appends (base + offset, distance)
+    void scan(const char* data, size_t length, size_t base, int maxDistance,
+              vector<pair<size_t, int>>& ends);
+    
+    // Distance of the best match ending at the last byte fed
+    int getScore() const { return score; }
 };
 
 // Advanced search engine with multiple algorithms
 class AdvancedSearchEngine {
+    friend class SearchCursor;
+    
 private:
-    static const long long PRIME = 1000000007;
-    static const int BASE = 256;
+    // Compiled regexes by (pattern, case sensitive); the lazy DFA states
+    // they have built are reused by later searches
+    mutable map<pair<string, bool>, shared_ptr<Regex>> regexCache;
+    static const size_t MAX_CACHED_REGEXES = 32;
     
-    // Rolling hash helpers
-    long long calculateHash(const string& str, int length) const;
-    long long recalculateHash(long long oldHash, char oldChar, char newChar,
-                             long long pow, int length) const;
-    long long power(long long base, int exp) const;
+    shared_ptr<Regex> getRegex(const string& pattern, bool caseSensitive, string* error = nullptr) const;
+    
+    // Suffix array of the buffer version searched last. A build costs many
+    // scans, so it waits until INDEX_AFTER_SEARCHES exact searches have hit
+    // the same version; an edit changes the version and starts the count over.
+    mutable SuffixArray index;
+    mutable uint64_t scannedVersion;
+    mutable size_t scansOfVersion;
+    bool indexing;
+    static const size_t INDEX_AFTER_SEARCHES = 8;
+    static const size_t MAX_INDEXED_LENGTH = 32 << 20;  // the index takes about 9 bytes per byte
+    
+    // Multi-threaded search: the text is cut into one range per thread,
+    // but never into ranges shorter than MIN_PARALLEL_LENGTH, and results
+    // are annotated in slices of at least MIN_PARALLEL_RESULTS matches
+    mutable shared_ptr<ThreadPool> pool;
+    static const size_t MIN_PARALLEL_LENGTH = 1 << 20;
+    static const size_t MIN_PARALLEL_RESULTS = 4096;
+    
+    // A search with maxResults scans a string this much at a time
+    static const size_t CAPPED_BLOCK_SIZE = 64 << 10;
+    
+    size_t requestedThreads(const SearchOptions& options) const;
+    ThreadPool& getPool(size_t threads) const;  // at least that many threads
+    
+    // scan(start, end, positions) appends the sorted matches inside
+    // [start, end). Ranges overlap by patternLength - 1, run in parallel
+    // and are merged in order.
+    template <typename Scan>
+    vector<size_t> scanRanges(size_t length, size_t patternLength, size_t ranges, Scan scan) const;
+    
+    // Whole-word filter, then line/column (from locate) and context
+    template <typename Text, typename Locate>
+    vector<SearchResult> buildResults(const Text& text, const vector<Regex::Match>& matches,
+                                      const SearchOptions& options, Locate locate) const;
+    
+    // search() on a buffer; useIndex = false leaves the suffix array and
+    // its search count alone (for buffers searched once)
+    vector<SearchResult> searchBuffer(const TextBuffer& buffer, const string& pattern,
+                                      const SearchOptions& options, bool useIndex) const;
+    
+    struct FuzzyMatch {
+        size_t position;
+        size_t length;
+        int distance;
+        
+        FuzzyMatch(size_t pos, size_t len, int dist) : position(pos), length(len), distance(dist) {}
+    };
+    
+    // Pieces shorter than this hit too often to be worth prefiltering on
+    static const size_t MIN_FUZZY_PIECE = 3;
+    
+    vector<FuzzyMatch> fuzzyScan(const BufferView& view, const string& pattern, int maxDistance,
+                                 bool caseSensitive) const;
     
     // Helper functions
     string toLowerCase(const string& str) const;
     bool isWordBoundary(char c) const;
-    void getLineAndColumn(const string& text, size_t pos, size_t& line, size_t& col) const;
-    string getContext(const string& text, size_t pos, int contextLines) const;
+    
+    // Line starts are computed once per search; each match is then a binary
+    // search. Only lines starting at or before end are listed.
+    vector<size_t> buildLineStarts(const string& text, size_t threads = 1,
+                                   size_t end = string::npos) const;
+    void getLineAndColumn(const vector<size_t>& lineStarts, size_t pos, size_t& line, size_t& col) const;
+    
+    // Text is a string or a BufferView
+    template <typename Text>
+    string getContext(const Text& text, size_t pos, int contextLines) const;
+    template <typename Text>
+    bool isWholeWord(const Text& text, size_t pos, size_t length) const;
     
     // Search algorithms
     vector<size_t> naiveSearch(const string& text, const string& pattern) const;
-    vector<size_t> kmpSearch(const string& text, const string& pattern) const;
-    vector<size_t> boyerMooreSearch(const string& text, const string& pattern) const;
+    template <typename Iterator>
+    vector<size_t> kmpScan(Iterator begin, Iterator end, const string& pattern, bool caseSensitive) const;
     
     // KMP helpers
     vector<int> computeLPSArray(const string& pattern) const;
     
     // Boyer-Moore helpers
-    vector<int> computeBadCharTable(const string& pattern) const;
+    vector<int> computeBadCharTable(const string& pattern, bool caseSensitive = true) const;
     
+    // Backward Horspool: windows move right to left and the shift comes from
+    // the window's first character, so the scan stops at the nearest match
+    vector<size_t> computeReverseShiftTable(const string& pattern) const;
+    template <typename Text, typename Iterator>
+    size_t reverseSearch(const Text& text, Iterator begin, const string& pattern, size_t before,
+                         const SearchOptions& options) const;
+
 public:
-    // Basic rolling hash search (from your existing implementation)
+    AdvancedSearchEngine() : scannedVersion(0), scansOfVersion(0), indexing(true) {}
+    
+    // Exact search, overlapping matches included. Kept under its old name;
+    // it now uses the SIMD prefilter instead of a rolling hash.
     vector<size_t> rollingHashSearch(const string& text, const string& pattern) const;
     
-    // Advanced search with options
+    // Exact search with one specific algorithm, overlapping matches included
+    vector<size_t> kmpSearch(const string& text, const string& pattern, bool caseSensitive = true) const;
+    vector<size_t> boyerMooreSearch(const string& text, const string& pattern,
+                                    bool caseSensitive = true) const;
+    
+    // Advanced search with options; with useRegex the pattern is a regular
+    // expression (see RegexEngine.h) and an invalid one finds nothing.
+    // searchBackward lists the results last to first. With threads != 1,
+    // exact scans of large texts and the annotation of many results run on
+    // a thread pool (a regular expression is still matched on one thread).
     vector<SearchResult> search(const string& text, const string& pattern,
                                const SearchOptions& options = SearchOptions()) const;
     
-   
+    // Same, over the buffer in place; line/column come from its line index.
+    // With maxResults the scan stops once that many results are found.
+    vector<SearchResult> search(const TextBuffer& buffer, const string& pattern,
+                               const SearchOptions& options = SearchOptions()) const;
+    
+    // Lazy version: results are found as they are read from the cursor
+    SearchCursor openSearch(const TextBuffer& buffer, const string& pattern,
+                            const SearchOptions& options = SearchOptions()) const;
+    
+    // Exact case-sensitive positions in the buffer, overlapping ones
+    // included; answered from the suffix array once it has been built
+    vector<size_t> findAll(const TextBuffer& buffer, const string& pattern) const;
+    
+    // Files of the index's directory that contain pattern: candidates come
+    // from the trigram index (every file for regular expressions) and each
+    // one is loaded and searched to confirm. Ordered by path.
+    vector<FileSearchResult> searchFiles(const TrigramIndex& files, const string& pattern,
+                                         const SearchOptions& options = SearchOptions()) const;
+    
+    // Turning indexing off also frees the index
+    void setIndexing(bool enabled);
+    bool isIndexed(const TextBuffer& buffer) const { return index.isCurrent(buffer); }
+    
+    // Nearest match starting before position `before` (e.g. the cursor),
+    // scanned right to left from there and stopping at the first hit.
+    // False when there is none. A string has no line index: pass its
+    // lineStarts (from getLineStarts) when stepping back through the same
+    // text repeatedly, otherwise the lines before the match are counted.
+    bool findPrevious(const string& text, const string& pattern, size_t before,
+                      const SearchOptions& options, SearchResult& result,
+                      const vector<size_t>* lineStarts = nullptr) const;
+    bool findPrevious(const TextBuffer& buffer, const string& pattern, size_t before,
+                      const SearchOptions& options, SearchResult& result) const;
+    
+    // Offset where each line of text starts
+    vector<size_t> getLineStarts(const string& text) const { return buildLineStarts(text); }
+    
+    bool isValidRegex(const string& pattern, string* error = nullptr) const;
+    
+    // Levenshtein distance (insertions, deletions and substitutions)
+    int editDistance(const string& a, const string& b) const;
+    
+    // Non-overlapping approximate matches within maxDistance edits, left to
+    // right, with their length and distance. Of overlapping candidates the
+    // one with the fewest edits (then the longest) is kept.
+    vector<SearchResult> fuzzySearch(const string& text, const string& pattern, int maxDistance,
+                                     const SearchOptions& options) const;
+    vector<SearchResult> fuzzySearch(const TextBuffer& buffer, const string& pattern, int maxDistance,
+                                     const SearchOptions& options) const;
+    
+    // Start positions only, case-sensitive
+    vector<size_t> fuzzySearch(const string& text, const string& pattern, int maxDistance) const;
+    
+    // All patterns in one pass; results are ordered by position and tagged
+    // with patternIndex
+    vector<SearchResult> multiPatternSearch(const string& text, const vector<string>& patterns,
+                                            const SearchOptions& options) const;
+    vector<SearchResult> multiPatternSearch(const TextBuffer& buffer, const vector<string>& patterns,
+                                            const SearchOptions& options) const;
+    
+    // Case-sensitive positions per pattern, in pattern order
+    vector<pair<string, vector<size_t>>> multiPatternSearch(const string& text,
+                                                            const vector<string>& patterns) const;
+
+
 };
 
 // Search history manager
@@ -84,7 +365,7 @@ private:
     
     vector<SearchEntry> history;
     static const size_t MAX_HISTORY = 50;
-    
+
 public:
     void addSearch(const string& pattern, int resultCount);
     vector<string> getRecentPatterns(int count = 10) const;
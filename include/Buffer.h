@@ -4,63 +4,406 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <iterator>
+#include <cstddef>
+#include <chrono>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <cstdint>
 
 using namespace std;
 
-// Custom Stack Implementation
+// Custom Stack Implementation: a growable contiguous array. Slots are
+// reused after pop, so push/pop allocate nothing once the capacity is
+// reached, and clear() is O(1) when T is trivially destructible.
 template <typename T>
 class Stack {
 private:
-    struct Node {
-        T data;
-        Node* next;
-        Node(const T& d) : data(d), next(nullptr) {}
-    };
+    T* items;          // raw storage; the first count slots are constructed
+    size_t count;
+    size_t capacity;
     
-    Node* topNode;
-    int size;
+    void grow() {
+        size_t newCapacity = capacity ? capacity * 2 : 16;
+        T* newItems = static_cast<T*>(::operator new(newCapacity * sizeof(T)));
+        for (size_t i = 0; i < count; i++) {
+            new (&newItems[i]) T(move(items[i]));
+            items[i].~T();
+        }
+        ::operator delete(items);
+        items = newItems;
+        capacity = newCapacity;
+    }
     
 public:
-    Stack() : topNode(nullptr), size(0) {}
+    Stack() : items(nullptr), count(0), capacity(0) {}
     
     ~Stack() {
-        while (!empty()) {
-            pop();
-        }
+        clear();
+        ::operator delete(items);
     }
     
+    Stack(const Stack&) = delete;
+    Stack& operator=(const Stack&) = delete;
+    
     void push(const T& data) {
-        Node* newNode = new Node(data);
-        newNode->next = topNode;
-        topNode = newNode;
-        size++;
+        if (count == capacity) grow();
+        new (&items[count]) T(data);
+        count++;
+    }
+    
+    void push(T&& data) {
+        if (count == capacity) grow();
+        new (&items[count]) T(move(data));
+        count++;
     }
     
     void pop() {
         if (empty()) return;
-        Node* temp = topNode;
-        topNode = topNode->next;
-        delete temp;
-        size--;
+        items[--count].~T();
+    }
+    
+    // Keeps the capacity for reuse
+    void clear() {
+        if (!is_trivially_destructible<T>::value) {
+            while (count > 0) {
+                items[--count].~T();
+            }
+        }
+        count = 0;
     }
     
     T& top() {
-        return topNode->data;
+        return items[count - 1];
+    }
+    
+    // Access from the bottom (oldest item first)
+    T& operator[](size_t index) {
+        return items[index];
     }
     
     const T& top() const {
-        return topNode->data;
+        return items[count - 1];
     }
     
     bool empty() const {
-        return topNode == nullptr;
+        return count == 0;
     }
     
     int getSize() const {
-        return size;
+        return (int)count;
     }
 };
 
+// Sequence of items kept in a treap ordered by position. Each item carries
+// a length and a newline count and every node the totals of its subtree, so
+// lookup by index, offset or line, insert, erase and weight updates are
+// O(log n). Nodes live in one pool and erased ones are reused.
+template <typename T>
+class WeightedSequence {
+private:
+    static const uint32_t NIL = 0xFFFFFFFF;
+    enum { LENGTH = 0, NEWLINES = 1 };
+    
+    struct Node {
+        T item;
+        uint32_t left;
+        uint32_t right;
+        uint32_t priority;
+        size_t count;      // items in the subtree
+        size_t weight[2];  // of this item
+        size_t sum[2];     // of the subtree
+    };
+    
+    vector<Node> nodes;
+    vector<uint32_t> freeNodes;
+    uint32_t root;
+    uint32_t seed;
+    
+    size_t countOf(uint32_t x) const { return x == NIL ? 0 : nodes[x].count; }
+    size_t sumOf(uint32_t x, int measure) const { return x == NIL ? 0 : nodes[x].sum[measure]; }
+    
+    void update(uint32_t x) {
+        Node& node = nodes[x];
+        node.count = 1 + countOf(node.left) + countOf(node.right);
+        for (int m = 0; m < 2; m++) {
+            node.sum[m] = node.weight[m] + sumOf(node.left, m) + sumOf(node.right, m);
+        }
+    }
+    
+    uint32_t newNode(T item, size_t length, size_t newlines) {
+        uint32_t x;
+        if (freeNodes.empty()) {
+            x = (uint32_t)nodes.size();
+            nodes.push_back(Node());
+        } else {
+            x = freeNodes.back();
+            freeNodes.pop_back();
+        }
+        
+        // xorshift32: priorities only need to look random
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        
+        Node& node = nodes[x];
+        node.item = move(item);
+        node.left = node.right = NIL;
+        node.priority = seed;
+        node.weight[LENGTH] = length;
+        node.weight[NEWLINES] = newlines;
+        update(x);
+        return x;
+    }
+    
+    // First count items of x go to a, the rest to b
+    void split(uint32_t x, size_t count, uint32_t& a, uint32_t& b) {
+        if (x == NIL) {
+            a = b = NIL;
+            return;
+        }
+        size_t leftCount = countOf(nodes[x].left);
+        if (count <= leftCount) {
+            split(nodes[x].left, count, a, nodes[x].left);
+            b = x;
+        } else {
+            split(nodes[x].right, count - leftCount - 1, nodes[x].right, b);
+            a = x;
+        }
+        update(x);
+    }
+    
+    uint32_t merge(uint32_t a, uint32_t b) {
+        if (a == NIL) return b;
+        if (b == NIL) return a;
+        if (nodes[a].priority > nodes[b].priority) {
+            uint32_t right = merge(nodes[a].right, b);
+            nodes[a].right = right;
+            update(a);
+            return a;
+        }
+        uint32_t left = merge(a, nodes[b].left);
+        nodes[b].left = left;
+        update(b);
+        return b;
+    }
+    
+    uint32_t nodeAt(size_t index) const {
+        uint32_t x = root;
+        for (;;) {
+            size_t leftCount = countOf(nodes[x].left);
+            if (index == leftCount) return x;
+            if (index < leftCount) {
+                x = nodes[x].left;
+            } else {
+                index -= leftCount + 1;
+                x = nodes[x].right;
+            }
+        }
+    }
+    
+    size_t prefixSum(size_t count, int measure) const {
+        size_t total = 0;
+        uint32_t x = root;
+        while (x != NIL && count > 0) {
+            size_t leftCount = countOf(nodes[x].left);
+            if (count <= leftCount) {
+                x = nodes[x].left;
+            } else {
+                total += sumOf(nodes[x].left, measure) + nodes[x].weight[measure];
+                count -= leftCount + 1;
+                x = nodes[x].right;
+            }
+        }
+        return total;
+    }
+    
+    size_t findByPrefix(size_t target, size_t& sumBefore, int measure) const {
+        size_t index = 0;
+        sumBefore = 0;
+        uint32_t x = root;
+        while (x != NIL) {
+            size_t leftSum = sumOf(nodes[x].left, measure);
+            if (target < leftSum) {
+                x = nodes[x].left;
+                continue;
+            }
+            size_t through = leftSum + nodes[x].weight[measure];
+            if (target < through) {
+                sumBefore += leftSum;
+                return index + countOf(nodes[x].left);
+            }
+            target -= through;
+            sumBefore += through;
+            index += countOf(nodes[x].left) + 1;
+            x = nodes[x].right;
+        }
+        return index;
+    }
+    
+    // Treap over items in order, in O(k): a stack holds the right spine
+    template <typename Weigh>
+    uint32_t build(vector<T>& items, Weigh weigh) {
+        vector<uint32_t> spine;
+        for (auto& item : items) {
+            size_t length, newlines;
+            weigh(item, length, newlines);
+            uint32_t x = newNode(move(item), length, newlines);
+            uint32_t last = NIL;
+            while (!spine.empty() && nodes[spine.back()].priority < nodes[x].priority) {
+                last = spine.back();
+                spine.pop_back();
+            }
+            nodes[x].left = last;
+            if (!spine.empty()) {
+                nodes[spine.back()].right = x;
+            }
+            spine.push_back(x);
+        }
+        items.clear();
+        if (spine.empty()) return NIL;
+        refresh(spine[0]);
+        return spine[0];
+    }
+    
+    void refresh(uint32_t x) {  // recomputes the totals of a subtree
+        if (x == NIL) return;
+        refresh(nodes[x].left);
+        refresh(nodes[x].right);
+        update(x);
+    }
+    
+    template <typename F>
+    void visit(uint32_t x, F f) const {  // in order
+        vector<uint32_t> stack;
+        while (x != NIL || !stack.empty()) {
+            while (x != NIL) {
+                stack.push_back(x);
+                x = nodes[x].left;
+            }
+            x = stack.back();
+            stack.pop_back();
+            f(x);
+            x = nodes[x].right;
+        }
+    }
+    
+public:
+    WeightedSequence() : root(NIL), seed(2463534242u) {}
+    
+    size_t size() const { return countOf(root); }
+    bool empty() const { return root == NIL; }
+    
+    T& operator[](size_t index) { return nodes[nodeAt(index)].item; }
+    const T& operator[](size_t index) const { return nodes[nodeAt(index)].item; }
+    T& back() { return (*this)[size() - 1]; }
+    
+    void insert(size_t index, T item, size_t length, size_t newlines) {
+        uint32_t x = newNode(move(item), length, newlines);
+        uint32_t a, b;
+        split(root, index, a, b);
+        root = merge(merge(a, x), b);
+    }
+    
+    // Inserts the items (consumed) before index; weigh(item, length, newlines)
+    template <typename Weigh>
+    void insert(size_t index, vector<T>& items, Weigh weigh) {
+        uint32_t middle = build(items, weigh);
+        uint32_t a, b;
+        split(root, index, a, b);
+        root = merge(merge(a, middle), b);
+    }
+    
+    // Removes the items in [first, last)
+    void erase(size_t first, size_t last) {
+        uint32_t a, middle, b;
+        split(root, last, middle, b);
+        split(middle, first, a, middle);
+        root = merge(a, b);
+        
+        visit(middle, [this](uint32_t x) {
+            nodes[x].item = T();
+            freeNodes.push_back(x);
+        });
+    }
+    
+    void add(size_t index, long long lengthDelta, long long newlineDelta) {
+        uint32_t x = root;
+        for (;;) {
+            Node& node = nodes[x];
+            node.sum[LENGTH] += static_cast<size_t>(lengthDelta);
+            node.sum[NEWLINES] += static_cast<size_t>(newlineDelta);
+            size_t leftCount = countOf(node.left);
+            if (index == leftCount) {
+                node.weight[LENGTH] += static_cast<size_t>(lengthDelta);
+                node.weight[NEWLINES] += static_cast<size_t>(newlineDelta);
+                return;
+            }
+            if (index < leftCount) {
+                x = node.left;
+            } else {
+                index -= leftCount + 1;
+                x = node.right;
+            }
+        }
+    }
+    
+    template <typename Weigh>
+    void assign(vector<T>& items, Weigh weigh) {
+        clear();
+        nodes.reserve(items.size());
+        root = build(items, weigh);
+    }
+    
+    // Recomputes every weight, e.g. once newlines have been counted
+    template <typename Weigh>
+    void reweigh(Weigh weigh) {
+        visit(root, [this, &weigh](uint32_t x) {
+            weigh(nodes[x].item, nodes[x].weight[LENGTH], nodes[x].weight[NEWLINES]);
+        });
+        refresh(root);
+    }
+    
+    // Moves the items out in order and empties the sequence
+    void moveTo(vector<T>& out) {
+        out.reserve(out.size() + size());
+        visit(root, [this, &out](uint32_t x) {
+            out.push_back(move(nodes[x].item));
+        });
+        clear();
+    }
+    
+    void clear() {
+        nodes.clear();
+        freeNodes.clear();
+        root = NIL;
+    }
+    
+    template <typename F>
+    void forEach(F f) const {
+        visit(root, [this, &f](uint32_t x) {
+            f(nodes[x].item);
+        });
+    }
+    
+    size_t totalLength() const { return sumOf(root, LENGTH); }
+    size_t totalNewlines() const { return sumOf(root, NEWLINES); }
+    size_t lengthBefore(size_t index) const { return prefixSum(index, LENGTH); }
+    size_t newlinesBefore(size_t index) const { return prefixSum(index, NEWLINES); }
+    
+    // Index of the first item whose running total exceeds target (size()
+    // if none); sumBefore receives the total of the items before it
+    size_t findByLength(size_t target, size_t& sumBefore) const {
+        return findByPrefix(target, sumBefore, LENGTH);
+    }
+    size_t findByNewlines(size_t target, size_t& sumBefore) const {
+        return findByPrefix(target, sumBefore, NEWLINES);
+    }
+};
+
+class TextBuffer;
+
 // Command pattern for undo/redo
 class Command {
 public:
@@ -68,47 +411,304 @@ public:
     virtual void execute() = 0;
     virtual void undo() = 0;
     virtual string getDescription() const = 0;
+    
+    // Brings in data kept outside the command (see SpilledCommand) before
+    // execute() or undo(); false if it cannot, and the step is refused
+    virtual bool prepare() { return true; }
+    
+    // Keystroke coalescing: if the edit continues this command and the
+    // merged text stays within maxLength, apply it and fold it in.
+    // Otherwise leave the buffer untouched and return false.
+    virtual bool mergeInsert(size_t, const string&, size_t) { return false; }
+    virtual bool mergeDelete(size_t, size_t, size_t) { return false; }
+    
+    // Undo memory budget: approximate heap footprint, and a record that
+    // deserialize() turns back into an equivalent command ("" = keep in memory)
+    virtual size_t memoryUsage() const = 0;
+    virtual string serialize() const = 0;
+    static shared_ptr<Command> deserialize(TextBuffer* buffer, const string& data);
 };
 
-// Text buffer using chunked storage
-class TextBuffer {
+// Contiguous run of characters owned by a TextStorage backend
+struct TextSpan {
+    const char* data;
+    size_t length;
+    
+    TextSpan(const char* d, size_t len) : data(d), length(len) {}
+};
+
+// Number of '\n' characters in data[0, length)
+inline size_t countNewlines(const char* data, size_t length) {
+    return count(data, data + length, '\n');
+}
+
+// Read-only view over the spans of a buffer (or a single string).
+// Nothing is copied; the view is invalidated by the next edit.
+class BufferView {
+private:
+    vector<TextSpan> spans;
+    vector<size_t> offsets;  // document position of each span's first character
+    size_t totalLength;
+    
+public:
+    // Random-access character iterator that crosses span boundaries
+    class const_iterator {
+    private:
+        const BufferView* view;
+        size_t spanIdx;
+        size_t offset;  // within the current span
+        size_t pos;     // within the document
+        
+        void seek(size_t newPos);
+        
+    public:
+        typedef random_access_iterator_tag iterator_category;
+        typedef char value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const char* pointer;
+        typedef const char& reference;
+        
+        const_iterator() : view(nullptr), spanIdx(0), offset(0), pos(0) {}
+        const_iterator(const BufferView* v, size_t position);
+        
+        reference operator*() const { return view->spans[spanIdx].data[offset]; }
+        char operator[](difference_type n) const { return *(*this + n); }
+        size_t position() const { return pos; }
+        
+        const_iterator& operator++();
+        const_iterator operator++(int) { const_iterator old = *this; ++*this; return old; }
+        const_iterator& operator--();
+        const_iterator operator--(int) { const_iterator old = *this; --*this; return old; }
+        const_iterator& operator+=(difference_type n) { seek(pos + n); return *this; }
+        const_iterator& operator-=(difference_type n) { seek(pos - n); return *this; }
+        const_iterator operator+(difference_type n) const { const_iterator it = *this; return it += n; }
+        const_iterator operator-(difference_type n) const { const_iterator it = *this; return it -= n; }
+        difference_type operator-(const const_iterator& other) const {
+            return (difference_type)pos - (difference_type)other.pos;
+        }
+        
+        bool operator==(const const_iterator& other) const { return pos == other.pos; }
+        bool operator!=(const const_iterator& other) const { return pos != other.pos; }
+        bool operator<(const const_iterator& other) const { return pos < other.pos; }
+        bool operator>(const const_iterator& other) const { return pos > other.pos; }
+        bool operator<=(const const_iterator& other) const { return pos <= other.pos; }
+        bool operator>=(const const_iterator& other) const { return pos >= other.pos; }
+    };
+    
+    BufferView();
+    explicit BufferView(const string& text);
+    explicit BufferView(const vector<TextSpan>& textSpans);
+    
+    size_t length() const { return totalLength; }
+    size_t getSpanCount() const { return spans.size(); }
+    const TextSpan& getSpan(size_t index) const { return spans[index]; }
+    size_t getSpanOffset(size_t index) const { return offsets[index]; }
+    size_t findSpan(size_t pos) const;  // index of the span holding pos
+    
+    char operator[](size_t pos) const;
+    string substr(size_t pos, size_t length) const;
+    BufferView subview(size_t pos, size_t length) const;  // same spans, trimmed; no copy
+    
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, totalLength); }
+};
+
+// One range of a bulk edit: replace length chars at position with text.
+// Positions refer to the document before any edit of the batch.
+struct TextEdit {
+    size_t position;
+    size_t length;
+    string text;
+    
+    TextEdit(size_t pos, size_t len, const string& txt) : position(pos), length(len), text(txt) {}
+};
+
+// Storage backend behind TextBuffer
+class TextStorage {
+public:
+    virtual ~TextStorage() = default;
+    virtual void insert(size_t pos, const string& text) = 0;
+    virtual void deleteText(size_t pos, size_t length) = 0;
+    
+    virtual string getText() const = 0;
+    virtual string getSubstring(size_t pos, size_t length) const = 0;
+    virtual size_t length() const = 0;
+    
+    // Append the backend's storage runs, in document order, without copying
+    virtual void getSpans(vector<TextSpan>& spans) const = 0;
+    
+    virtual void clear() = 0;
+    virtual void setText(const string& text) = 0;
+    
+    // Backends that can adopt the caller's string override this to avoid a copy
+    virtual void setText(string&& text) { setText(static_cast<const string&>(text)); }
+    
+    // Load read-only text owned by the caller (e.g. a memory-mapped file).
+    // Backends that can reference it in place override this; the memory must
+    // stay valid until the next setText/clear.
+    virtual void setExternalText(const char* data, size_t length) { setText(string(data, length)); }
+    
+    // Line index: newlines in [0, pos), and the position of the n-th
+    // newline (1-based), or length() when there are fewer than n
+    virtual size_t countNewlinesBefore(size_t pos) const = 0;
+    virtual size_t findNewline(size_t n) const = 0;
+    
+    // Batch hint: between these calls a backend may let its structure
+    // drift and repair it once at endBatch()
+    virtual void beginBatch() {}
+    virtual void endBatch() {}
+    
+    // Apply sorted, non-overlapping edits. The default goes right to left
+    // through insert/delete; backends override it with a single pass.
+    virtual void applyEdits(const vector<TextEdit>& edits);
+};
+
+// Chunked storage: the document is split into ~CHUNK_SIZE byte strings
+class ChunkedStorage : public TextStorage {
 private:
     static const size_t CHUNK_SIZE = 256;
-    vector<string> chunks;
+    static const size_t MIN_CHUNK_SIZE = CHUNK_SIZE / 2;
+    static const size_t MAX_CHUNK_SIZE = CHUNK_SIZE * 2;
+    static const size_t EXTERNAL_CHUNK_SIZE = 64 * 1024;  // slices of external text
+    static const size_t BATCH_MAX_CHUNK_SIZE = CHUNK_SIZE * 16;  // split limit inside a batch
+    
+    // A chunk either owns its text or borrows a read-only slice of external
+    // text. Borrowed chunks are copied into owned ones only when edited.
+    struct Chunk {
+        string text;
+        const char* borrowed;
+        size_t borrowedLength;
+        mutable size_t newlines;  // only meaningful while lineCountsValid
+        
+        Chunk() : borrowed(nullptr), borrowedLength(0), newlines(0) {}
+        explicit Chunk(string t) : text(move(t)), borrowed(nullptr), borrowedLength(0), newlines(0) {}
+        Chunk(const char* data, size_t len) : borrowed(data), borrowedLength(len), newlines(0) {}
+        
+        bool isBorrowed() const { return borrowed != nullptr; }
+        size_t length() const { return borrowed ? borrowedLength : text.length(); }
+        const char* data() const { return borrowed ? borrowed : text.data(); }
+        
+        string& materialize();
+        void erase(size_t pos, size_t count);
+    };
+    
+    // Chunks with their lengths and newline counts, so finding the chunk at
+    // an offset or line and splitting or merging chunks are O(log n).
+    // Newlines are counted on the first line query after a load (hence
+    // mutable), then maintained by every edit.
+    mutable WeightedSequence<Chunk> chunks;
     size_t totalLength;
+    mutable bool lineCountsValid;
+    
+    bool batchMode;  // defer merges and most splits until endBatch()
+    
+    static void appendSplit(string text, vector<Chunk>& out);
+    static void weighChunk(const Chunk& chunk, size_t& length, size_t& newlines);
+    void normalizeChunks(vector<Chunk>& source);  // repair sizes in one pass into chunks
+    void resizeChunk(size_t chunkIdx, long long delta, long long newlineDelta);
+    void ensureLineCounts() const;
     
-    void rebalance();
+    // Local rebalancing: only the touched chunk and its neighbour are
+    // split or merged, so an edit costs O(CHUNK_SIZE + log n) instead of O(n)
+    void rebalanceChunk(size_t chunkIdx);
+    void splitChunk(size_t chunkIdx);
     size_t getChunkIndex(size_t pos, size_t& localPos) const;
     
 public:
-    TextBuffer();
-    explicit TextBuffer(const string& text);
+    ChunkedStorage();
+    
+    void insert(size_t pos, const string& text) override;
+    void deleteText(size_t pos, size_t length) override;
+    
+    string getText() const override;
+    string getSubstring(size_t pos, size_t length) const override;
+    size_t length() const override { return totalLength; }
+    void getSpans(vector<TextSpan>& spans) const override;
+    
+    void clear() override;
+    void setText(const string& text) override;
+    void setExternalText(const char* data, size_t length) override;
+    
+    size_t countNewlinesBefore(size_t pos) const override;
+    size_t findNewline(size_t n) const override;
+    
+    void beginBatch() override { batchMode = true; }
+    void endBatch() override;
+    void applyEdits(const vector<TextEdit>& edits) override;
+};
+
+// Available TextBuffer storage backends
+enum class BufferBackend {
+    Chunked,     // Array of small chunks (default)
+    PieceTable,  // Read-only original text + append-only add buffer
+    Rope         // Balanced tree of short leaf strings
+};
+
+class MappedFile;
+class UndoSpillFile;
+class TrigramIndex;
+
+// Text buffer; the storage backend is chosen at construction
+class TextBuffer {
+private:
+    BufferBackend backend;
+    unique_ptr<TextStorage> storage;
+    shared_ptr<MappedFile> mappedFile;  // keeps borrowed file pages alive
+    uint64_t version;
+    
+    static unique_ptr<TextStorage> createStorage(BufferBackend backend);
+    void touch();
+    
+public:
+    explicit TextBuffer(BufferBackend backend = BufferBackend::Chunked);
+    explicit TextBuffer(const string& text, BufferBackend backend = BufferBackend::Chunked);
     
     void insert(size_t pos, const string& text);
     void deleteText(size_t pos, size_t length);
     void replace(size_t pos, size_t length, const string& text);
     
+    // Bulk edit in one pass; false (and nothing applied) unless the edits
+    // are sorted, non-overlapping and inside the document
+    bool applyEdits(const vector<TextEdit>& edits);
+    
     string getText() const;
     string getSubstring(size_t pos, size_t length) const;
-    size_t length() const { return totalLength; }
+    size_t length() const { return storage->length(); }
+    BufferBackend getBackend() const { return backend; }
+    
+    // Zero-copy read access; invalidated by the next edit
+    BufferView getView() const;
+    
+    // Changes on every edit and is never shared by two buffers, so caches
+    // derived from the text can be keyed by it
+    uint64_t getVersion() const { return version; }
+    
+    // Line index (1-based lines and columns), O(log n) per query
+    size_t getLineCount() const;
+    size_t getLineStart(size_t line) const;  // clamped to the last line
+    void getLineAndColumn(size_t pos, size_t& line, size_t& col) const;
     
     void clear();
     void setText(const string& text);
+    void setText(string&& text);
+    
+    // Group many edits; structural upkeep is deferred to endBatch()
+    void beginBatch() { storage->beginBatch(); }
+    void endBatch() { storage->endBatch(); }
+    
+    // Reference a memory-mapped file without copying it
+    void setMappedText(shared_ptr<MappedFile> file);
 };
 
-// Rolling hash implementation for pattern search (Rabin-Karp)
+// Exact substring search, overlapping matches included. Candidates come from
+// the SIMD first/last byte filter in SimdScan and are verified with memcmp.
 class SearchEngine {
-private:
-    static const long long PRIME = 1000000007;
-    static const int BASE = 256;
-    
-    long long calculateHash(const string& str, int length) const;
-    long long recalculateHash(long long oldHash, char oldChar, char newChar, 
-                             long long pow, int length) const;
-    long long power(long long base, int exp) const;
-    
 public:
+    // Drop matches overlapping an earlier one, as a left-to-right replace would
+    static void keepNonOverlapping(vector<size_t>& positions, size_t patternLength);
+    
     vector<size_t> search(const string& text, const string& pattern) const;
+    vector<size_t> search(const BufferView& text, const string& pattern) const;
     vector<size_t> searchAndReplace(string& text, const string& pattern, 
                                     const string& replacement) const;
 };
@@ -125,6 +725,9 @@ public:
     void execute() override;
     void undo() override;
     string getDescription() const override;
+    bool mergeInsert(size_t pos, const string& txt, size_t maxLength) override;  // typing forward
+    size_t memoryUsage() const override;
+    string serialize() const override;
 };
 
 class DeleteCommand : public Command {
@@ -136,9 +739,13 @@ private:
     
 public:
     DeleteCommand(TextBuffer* buf, size_t pos, size_t len);
+    DeleteCommand(TextBuffer* buf, size_t pos, const string& deleted);  // already executed
     void execute() override;
     void undo() override;
     string getDescription() const override;
+    bool mergeDelete(size_t pos, size_t len, size_t maxLength) override;  // backspace or delete key
+    size_t memoryUsage() const override;
+    string serialize() const override;
 };
 
 class ReplaceCommand : public Command {
@@ -151,9 +758,86 @@ private:
     
 public:
     ReplaceCommand(TextBuffer* buf, size_t pos, size_t len, const string& txt);
+    ReplaceCommand(TextBuffer* buf, size_t pos, const string& oldTxt, const string& txt);  // already executed
+    void execute() override;
+    void undo() override;
+    string getDescription() const override;
+    size_t memoryUsage() const override;
+    string serialize() const override;
+};
+
+// Create the data/ folder if it does not exist yet
+void ensureDataFolderExists();
+
+// Edits recorded by a transaction, undone and redone as one step.
+// Each edit replaced oldText at position with newText.
+class CompositeCommand : public Command {
+private:
+    struct Edit {
+        size_t position;
+        string oldText;
+        string newText;
+        
+        Edit(size_t pos, string oldTxt, string newTxt)
+            : position(pos), oldText(move(oldTxt)), newText(move(newTxt)) {}
+    };
+    
+    TextBuffer* buffer;
+    vector<Edit> edits;
+    
+public:
+    explicit CompositeCommand(TextBuffer* buf) : buffer(buf) {}
+    
+    void record(size_t pos, string oldText, string newText);  // edit already applied
+    bool empty() const { return edits.empty(); }
+    size_t getEditCount() const { return edits.size(); }
+    
     void execute() override;
     void undo() override;
     string getDescription() const override;
+    size_t memoryUsage() const override;
+    string serialize() const override;
+};
+
+// Bulk edit applied in one buffer pass and undone as one step
+class MultiEditCommand : public Command {
+private:
+    TextBuffer* buffer;
+    vector<TextEdit> edits;
+    vector<string> oldTexts;  // captured on execute
+    
+public:
+    MultiEditCommand(TextBuffer* buf, vector<TextEdit> rangeEdits);
+    MultiEditCommand(TextBuffer* buf, vector<TextEdit> rangeEdits, vector<string> removed);  // already executed
+    
+    void execute() override;
+    void undo() override;
+    string getDescription() const override;
+    size_t memoryUsage() const override;
+    string serialize() const override;
+};
+
+// Replace-all undo record: one copy of the matched and replacement text
+// plus the match offsets (in the text before the replace)
+class ReplaceAllCommand : public Command {
+private:
+    TextBuffer* buffer;
+    vector<size_t> positions;
+    string oldText;
+    string newText;
+    
+    vector<TextEdit> buildEdits(bool inverse) const;
+    
+public:
+    ReplaceAllCommand(TextBuffer* buf, vector<size_t> matches, const string& oldTxt, const string& newTxt);
+    
+    size_t getMatchCount() const { return positions.size(); }
+    
+    void execute() override;
+    void undo() override;
+    string getDescription() const override;
+    size_t memoryUsage() const override;
+    string serialize() const override;
 };
 
 // Helper function to add data/ prefix to filenames
@@ -170,31 +854,134 @@ inline string addDataFolder(const string& filename) {
     return "data/" + filename;
 }
 
+// Undo history as a tree of document states. Undoing and then editing
+// starts a new branch instead of discarding the redo path. Nodes are kept
+// in creation order; node 0 is the state before the first edit.
+class UndoTree {
+public:
+    static const size_t NONE = static_cast<size_t>(-1);
+    
+    struct Node {
+        shared_ptr<Command> command;  // edit from the parent state to this one
+        size_t parent;
+        size_t depth;
+        size_t redoChild;             // branch that redo follows (NONE for a leaf)
+        vector<size_t> children;
+        chrono::system_clock::time_point created;
+        
+        Node(shared_ptr<Command> cmd, size_t p, size_t d)
+            : command(move(cmd)), parent(p), depth(d), redoChild(NONE),
+              created(chrono::system_clock::now()) {}
+    };
+    
+private:
+    vector<Node> nodes;
+    size_t current;
+    
+public:
+    UndoTree();
+    
+    // New child of the current state; it becomes the current state
+    size_t add(shared_ptr<Command> cmd);
+    
+    // Steps between states through their closest common ancestor:
+    // nodes to undo (walking up from current) and to redo (walking down)
+    void findPath(size_t target, vector<size_t>& undoPath, vector<size_t>& redoPath) const;
+    
+    // Latest state created at or before the given time
+    size_t findByTime(chrono::system_clock::time_point when) const;
+    
+    Node& getNode(size_t id) { return nodes[id]; }
+    const Node& getNode(size_t id) const { return nodes[id]; }
+    size_t getCurrent() const { return current; }
+    void setCurrent(size_t id) { current = id; }
+    size_t size() const { return nodes.size(); }
+    
+    void clear();
+};
+
 // Main Editor class
 class TextEditor {
 private:
     TextBuffer buffer;
-    Stack<shared_ptr<Command>> undoStack;
-    Stack<shared_ptr<Command>> redoStack;
+    UndoTree history;
     SearchEngine searchEngine;
     string filename;
     bool modified;
     
-    void clearRedoStack();
+    // Keystroke coalescing window; a zero window disables it
+    unsigned int coalesceWindowMs;
+    size_t coalesceMaxChars;
+    bool coalesceOpen;  // the current state's command may still absorb edits
+    chrono::steady_clock::time_point lastEditTime;
+    
+    // Undo memory budget; once exceeded the oldest commands are
+    // spilled to a file under data/ (0 = unlimited)
+    size_t undoMemoryBudget;
+    size_t undoMemory;              // bytes held by the undo tree
+    size_t spillWatermark;          // tree nodes below this are already on disk
+    shared_ptr<UndoSpillFile> spillFile;
+    
+    // Directory index told about every save (may be null)
+    shared_ptr<TrigramIndex> fileIndex;
+    
+    bool canCoalesce();
+    void pushUndo(shared_ptr<Command> cmd);
+    void resetHistory();  // fresh undo tree, nothing spilled
+    void enforceUndoBudget();
+    // False, leaving the state as it was, if the command cannot be loaded
+    bool stepUndo();               // current state -> its parent
+    bool stepRedo(size_t child);   // current state -> child
+    bool jumpTo(size_t state);     // stops at the first step refused
+    
+    // Open transaction; its edits skip the per-call undo bookkeeping
+    shared_ptr<CompositeCommand> transaction;
+    int transactionDepth;
     
 public:
-    TextEditor();
+    explicit TextEditor(BufferBackend backend = BufferBackend::Chunked);
     
     // Basic operations
     void insert(size_t pos, const string& text);
     void deleteText(size_t pos, size_t length);
     void replace(size_t pos, size_t length, const string& text);
     
-    // Undo/Redo
+    // Multi-range edit (e.g. multiple cursors): sorted (pos, len, text)
+    // ranges in original coordinates, applied in one pass as one undo step
+    bool applyEdits(const vector<TextEdit>& edits);
+    
+    // Batch edits: everything between beginTransaction() and the matching
+    // commit() becomes one undo step, and the buffer repairs its structure
+    // once at commit. Transactions nest; only the outermost commit records.
+    void beginTransaction();
+    bool commit();
+    bool rollback();  // undo the open transaction's edits
+    bool inTransaction() const { return transactionDepth > 0; }
+    
+    // Merge contiguous inserts, and backspace/delete runs, that arrive within
+    // windowMs of each other into one undo step of at most maxChars.
+    // Off by default; a keystroke-driven front end turns it on.
+    void setCoalescing(unsigned int windowMs, size_t maxChars = 4096);
+    
+    // Cap the memory held by undo/redo history (0 = unlimited)
+    void setUndoMemoryBudget(size_t bytes);
+    size_t getUndoMemoryUsage() const { return undoMemory; }
+    size_t getUndoSpillSize() const;  // bytes written to the spill file
+    
+    // Undo/Redo; redo follows the most recently visited branch. False
+    // when there is nothing to do or a spilled command cannot be read.
     bool undo();
     bool redo();
-    bool canUndo() const { return !undoStack.empty(); }
-    bool canRedo() const { return !redoStack.empty(); }
+    bool canUndo() const { return history.getCurrent() != 0; }
+    bool canRedo() const { return history.getNode(history.getCurrent()).redoChild != UndoTree::NONE; }
+    int getUndoCount() const { return (int)history.getNode(history.getCurrent()).depth; }
+    
+    // Undo tree navigation, O(depth): undo up to the common ancestor and
+    // redo down to the target. False if a step was refused on the way.
+    bool jumpToState(size_t state);
+    bool jumpToTime(chrono::system_clock::time_point when);
+    size_t getCurrentState() const { return history.getCurrent(); }
+    const UndoTree& getHistory() const { return history; }
     
     // Search operations
     vector<size_t> search(const string& pattern) const;
@@ -204,13 +991,39 @@ public:
     bool loadFromFile(const string& filepath);
     bool saveToFile(const string& filepath = "");
     
+    // Saves into the index's directory re-index the saved file
+    void setFileIndex(shared_ptr<TrigramIndex> index) { fileIndex = move(index); }
+    
     // Getters
     string getText() const { return buffer.getText(); }
+    BufferView getView() const { return buffer.getView(); }
+    const TextBuffer& getBuffer() const { return buffer; }
     size_t getLength() const { return buffer.length(); }
+    
+    // Goto line: start position of a 1-based line, from the buffer's line index
+    size_t gotoLine(size_t line) const { return buffer.getLineStart(line); }
+    size_t getLineCount() const { return buffer.getLineCount(); }
     bool isModified() const { return modified; }
     string getFilename() const { return filename; }
     
     void clear();
 };
 
+// Scoped transaction: begins on construction and commits when it goes out
+// of scope unless committed or rolled back earlier
+class TransactionGuard {
+private:
+    TextEditor& editor;
+    bool active;
+    
+public:
+    explicit TransactionGuard(TextEditor& ed) : editor(ed), active(true) { editor.beginTransaction(); }
+    ~TransactionGuard() { commit(); }
+    TransactionGuard(const TransactionGuard&) = delete;
+    TransactionGuard& operator=(const TransactionGuard&) = delete;
+    
+    void commit() { if (active) { editor.commit(); active = false; } }
+    void rollback() { if (active) { editor.rollback(); active = false; } }
+};
+
 #endif // BUFFER_H
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+
+using namespace std;
+
+// Read-only memory mapping of a whole file (POSIX mmap).
+// On platforms without mmap, open() fails and callers fall back to streams.
+class MappedFile {
+private:
+    const char* data;
+    size_t size;
+    string path;
+    
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    bool open(const string& filepath);
+    void close();
+    
+    const char* getData() const { return data; }
+    size_t getSize() const { return size; }
+    const string& getPath() const { return path; }
+    bool isOpen() const { return data != nullptr; }
+};
+
+#endif // MAPPED_FILE_H
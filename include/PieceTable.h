@@ -0,0 +1,73 @@
+#ifndef PIECE_TABLE_H
+#define PIECE_TABLE_H
+
+#include "Buffer.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Piece table storage: the loaded text is kept read-only (in one string or
+// in caller-owned memory such as a mapped file) and
+// every inserted character is appended to an add buffer. The document is
+// the sequence of pieces, each one a slice of either buffer.
+class PieceTableStorage : public TextStorage {
+private:
+    struct Piece {
+        bool inAdded;   // slice of the add buffer (true) or original (false)
+        size_t start;
+        size_t length;
+        
+        Piece() : inAdded(false), start(0), length(0) {}
+        Piece(bool added, size_t s, size_t len) : inAdded(added), start(s), length(len) {}
+    };
+    
+    string ownedOriginal;        // loaded text when it was handed over as a string
+    const char* originalData;    // read-only original text (owned or external)
+    size_t originalLength;
+    string added;                // append-only
+    size_t totalLength;
+    
+    // Pieces with their lengths and newline counts, so finding the piece at
+    // an offset or line, splitting and inserting are O(log n). Newlines of
+    // original pieces are weighed once the line index exists (hence mutable).
+    mutable WeightedSequence<Piece> pieces;
+    
+    // Line index: sorted newline offsets of each buffer. The original's list
+    // is built on the first line query; the add buffer's grows with it.
+    mutable vector<size_t> originalNewlines;
+    mutable bool lineIndexReady;
+    vector<size_t> addedNewlines;
+    
+    const char* pieceData(const Piece& piece) const;
+    size_t pieceNewlines(const Piece& piece, size_t length) const;  // in the first length chars
+    void weighPiece(const Piece& piece, size_t& length, size_t& newlines) const;
+    void appendAdded(const string& text);
+    void ensureLineIndex() const;
+    size_t getPieceIndex(size_t pos, size_t& localPos) const;
+    size_t splitAt(size_t pos);  // returns index of the piece starting at pos
+    
+public:
+    PieceTableStorage();
+    
+    void insert(size_t pos, const string& text) override;
+    void deleteText(size_t pos, size_t length) override;
+    void applyEdits(const vector<TextEdit>& edits) override;
+    
+    string getText() const override;
+    string getSubstring(size_t pos, size_t length) const override;
+    size_t length() const override { return totalLength; }
+    void getSpans(vector<TextSpan>& spans) const override;
+    
+    void clear() override;
+    void setText(const string& text) override;
+    void setText(string&& text) override;
+    void setExternalText(const char* data, size_t length) override;
+    
+    size_t countNewlinesBefore(size_t pos) const override;
+    size_t findNewline(size_t n) const override;
+    
+    size_t getPieceCount() const { return pieces.size(); }
+};
+
+#endif // PIECE_TABLE_H
@@ -0,0 +1,126 @@
+#ifndef REGEX_ENGINE_H
+#define REGEX_ENGINE_H
+
+#include "Buffer.h"
+#include <bitset>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Regular expression compiled to a Thompson NFA. Match starts come from a
+// lazy DFA over the reversed pattern: a DFA state (a set of NFA states) is
+// built the first time a scan reaches it and kept in a bounded cache. The
+// matches themselves come from one forward pass of a Pike VM, so finding
+// all of them takes O(text length * pattern states).
+//
+// Syntax: literals, ., [...] and [^...] with ranges, \d \w \s and their
+// negations, \n \t \r, escaped punctuation, (...) and (?:...), |,
+// * + ? {m} {m,} {m,n}, and ^ $ as line anchors. Matches are
+// leftmost-longest and never empty.
+class Regex {
+public:
+    struct Match {
+        size_t position;
+        size_t length;
+        
+        Match(size_t pos, size_t len) : position(pos), length(len) {}
+    };
+    
+private:
+    struct NfaState {
+        enum Type { Char, Split, LineStart, LineEnd, Accept };
+        
+        Type type;
+        bitset<256> chars;  // Char: bytes that lead to next[0]
+        vector<int> next;
+        
+        explicit NfaState(Type t) : type(t) {}
+    };
+    
+    // DFA over one NFA. Transitions are built on first use; when the cache
+    // reaches MAX_STATES it is flushed and rebuilt from the current state.
+    class LazyDfa {
+    private:
+        struct State {
+            vector<int> nfaStates;  // sorted epsilon closure
+            bool afterNewline;      // ^ holds here
+            bool acceptAlways;
+            bool acceptAtLineEnd;   // accepts if the next byte is '\n' or the end
+            bool dead;
+        };
+        
+        const vector<NfaState>* nfa;
+        int startNfa;
+        bool unanchored;  // restart at every position
+        vector<State> states;
+        vector<int> transitions;  // states * 256, -1 = not built yet
+        map<pair<vector<int>, bool>, int> stateIds;
+        mutable vector<unsigned> visited;
+        mutable unsigned visitMark;
+        
+        void closure(vector<int>& set, bool lineStartOk, bool lineEndOk) const;
+        int intern(vector<int>& set, bool afterNewline);
+        int buildTransition(int state, unsigned char c);
+    
+    public:
+        static const size_t MAX_STATES = 4096;
+        
+        LazyDfa() : nfa(nullptr), startNfa(0), unanchored(false), visitMark(0) {}
+        void init(const vector<NfaState>* automaton, int start, bool restartEverywhere);
+        
+        int startState(bool afterNewline);
+        int step(int state, unsigned char c) {
+            int next = transitions[state * 256 + c];
+            return next >= 0 ? next : buildTransition(state, c);
+        }
+        bool accepts(int state, bool atLineEnd) const {
+            return states[state].acceptAlways || (atLineEnd && states[state].acceptAtLineEnd);
+        }
+        bool isDead(int state) const { return states[state].dead; }
+        size_t getStateCount() const { return states.size(); }
+    };
+    
+    struct Node;
+    class Parser;
+    
+    string pattern;
+    bool caseSensitive;
+    vector<NfaState> forwardNfa;
+    int forwardStart;
+    vector<NfaState> reverseNfa;  // the pattern read right to left
+    mutable LazyDfa reverse;      // unanchored: where matches start
+    
+    static const size_t MAX_NFA_STATES = 100000;
+    
+    static int compileNode(const Node& node, int next, bool reversed, vector<NfaState>& nfa);
+    
+    // Pike VM step: adds state and everything it reaches without reading a
+    // byte to list. States already on the list keep their thread, which
+    // started no later because threads are added in order of start.
+    void addThread(vector<int>& list, vector<size_t>& startOf, int state, size_t start,
+                   bool lineStart, bool lineEnd, vector<int>& stack) const;
+    
+    Regex() : caseSensitive(true), forwardStart(0) {}
+    
+public:
+    // nullptr (and a message in error, if given) when the pattern is invalid
+    static shared_ptr<Regex> compile(const string& pattern, bool caseSensitive = true,
+                                     string* error = nullptr);
+    
+    Regex(const Regex&) = delete;
+    Regex& operator=(const Regex&) = delete;
+    
+    // Non-overlapping matches, left to right
+    vector<Match> findAll(const string& text) const;
+    vector<Match> findAll(const BufferView& view) const;
+    
+    const string& getPattern() const { return pattern; }
+    bool isCaseSensitive() const { return caseSensitive; }
+    size_t getCachedStateCount() const { return reverse.getStateCount(); }
+};
+
+#endif // REGEX_ENGINE_H
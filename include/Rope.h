@@ -0,0 +1,75 @@
+#ifndef ROPE_H
+#define ROPE_H
+
+#include "Buffer.h"
+#include <string>
+
+using namespace std;
+
+// Rope storage: a height-balanced (AVL) binary tree whose leaves hold short
+// strings. Internal nodes cache the length and newline count of their
+// subtree, so locating a position or a line,
+// inserting, deleting and extracting a substring are all O(log n)
+// plus the size of the text being copied.
+class RopeStorage : public TextStorage {
+private:
+    static const size_t LEAF_SIZE = 512;       // leaves are built at this size
+    static const size_t MAX_LEAF_SIZE = 1024;  // in-place edits may grow a leaf up to here
+    
+    struct Node {
+        Node* left;
+        Node* right;
+        size_t length;    // characters in this subtree
+        size_t newlines;  // '\n' characters in this subtree
+        int height;       // 1 for leaves
+        string text;      // leaves only
+        
+        explicit Node(const string& t)
+            : left(nullptr), right(nullptr), length(0), newlines(0), height(1), text(t) { update(); }
+        Node(Node* l, Node* r)
+            : left(l), right(r), length(0), newlines(0), height(0) { update(); }
+        
+        bool isLeaf() const { return left == nullptr; }
+        void update();
+    };
+    
+    Node* root;
+    
+    static int height(Node* node) { return node ? node->height : 0; }
+    static void destroy(Node* node);
+    static Node* build(const string& text, size_t begin, size_t end);
+    static Node* rotateLeft(Node* node);
+    static Node* rotateRight(Node* node);
+    static Node* rebalance(Node* node);
+    static Node* join(Node* left, Node* right);
+    static void split(Node* node, size_t pos, Node*& left, Node*& right);
+    
+    static bool insertInLeaf(Node* node, size_t pos, const string& text);
+    static bool deleteInLeaf(Node* node, size_t pos, size_t length);
+    static void collect(const Node* node, size_t pos, size_t length, string& out);
+    static void collectSpans(const Node* node, vector<TextSpan>& spans);
+    
+public:
+    RopeStorage();
+    ~RopeStorage();
+    RopeStorage(const RopeStorage&) = delete;
+    RopeStorage& operator=(const RopeStorage&) = delete;
+    
+    void insert(size_t pos, const string& text) override;
+    void deleteText(size_t pos, size_t length) override;
+    
+    string getText() const override;
+    string getSubstring(size_t pos, size_t length) const override;
+    size_t length() const override { return root ? root->length : 0; }
+    void getSpans(vector<TextSpan>& spans) const override;
+    
+    void clear() override;
+    void setText(const string& text) override;
+    
+    size_t countNewlinesBefore(size_t pos) const override;
+    size_t findNewline(size_t n) const override;
+    
+    int getHeight() const { return height(root); }
+};
+
+#endif // ROPE_H
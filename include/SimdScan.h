@@ -0,0 +1,44 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include "Buffer.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Instruction set used by the substring scanner
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+    Best  // whatever the running CPU supports
+};
+
+// Detected once per process (CPUID on x86, Scalar elsewhere)
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+// Appends base + offset of every occurrence of pattern in text, overlapping
+// ones included. Candidate windows are found by comparing the pattern's
+// first and last bytes 16 or 32 positions at a time; each candidate is then
+// checked with memcmp. Levels the CPU lacks fall back to the best it has.
+void findOccurrences(const char* text, size_t textLength, const string& pattern,
+                     vector<size_t>& positions, size_t base = 0,
+                     SimdLevel level = SimdLevel::Best);
+
+// Same over a buffer view: each span is scanned in place and only the few
+// bytes around span boundaries are copied
+void findOccurrences(const BufferView& view, const string& pattern, vector<size_t>& positions,
+                     SimdLevel level = SimdLevel::Best);
+
+// ASCII case-insensitive versions. The fold happens inside the scan (an OR
+// of 0x20 on letter bytes in the filter, a vector fold in the compare), so
+// no lowercased copy of the text is made.
+void findOccurrencesIgnoreCase(const char* text, size_t textLength, const string& pattern,
+                               vector<size_t>& positions, size_t base = 0,
+                               SimdLevel level = SimdLevel::Best);
+void findOccurrencesIgnoreCase(const BufferView& view, const string& pattern,
+                               vector<size_t>& positions, SimdLevel level = SimdLevel::Best);
+
+#endif // SIMD_SCAN_H
@@ -0,0 +1,54 @@
+#ifndef SUFFIX_ARRAY_H
+#define SUFFIX_ARRAY_H
+
+#include "Buffer.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Suffix array and LCP array of one version of a buffer. The suffix array
+// is built with SA-IS and the LCP array with Kasai's algorithm, both linear
+// in the text. An exact lookup is a binary search of O(m log n) for the
+// first matching suffix; the LCP array then gives the rest of the range in
+// time proportional to the matches.
+class SuffixArray {
+private:
+    string text;              // copy of the indexed version
+    vector<int32_t> suffixes; // suffix start offsets in sorted order
+    vector<int32_t> lcp;      // lcp[i]: common prefix of suffixes i - 1 and i (lcp[0] = 0)
+    uint64_t version;
+    bool built;
+    
+    // Compares the suffix at start with pattern over the pattern's length
+    int comparePrefix(size_t start, const string& pattern) const;
+
+public:
+    // Offsets are 32-bit, so larger documents cannot be indexed
+    static const size_t MAX_TEXT_LENGTH = 0x7FFFFFFE;
+    
+    SuffixArray() : version(0), built(false) {}
+    
+    // False (and nothing kept) when the text is too long. The document is
+    // kept, so pass a temporary (or move) to avoid copying it.
+    bool build(const TextBuffer& buffer);
+    bool build(string document);
+    void clear();
+    
+    bool isBuilt() const { return built; }
+    bool isCurrent(const TextBuffer& buffer) const { return built && version == buffer.getVersion(); }
+    
+    // Every occurrence, overlapping ones included, in ascending order
+    vector<size_t> find(const string& pattern) const;
+    size_t count(const string& pattern) const;
+    
+    // Longest substring occurring at least twice; length 0 if none
+    void longestRepeat(size_t& position, size_t& length) const;
+    
+    const vector<int32_t>& getSuffixes() const { return suffixes; }
+    const vector<int32_t>& getLcp() const { return lcp; }
+    size_t memoryUsage() const;
+};
+
+#endif // SUFFIX_ARRAY_H
@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed set of worker threads for data-parallel loops. The thread that
+// calls parallelFor() works on the tasks too, so a pool of size n starts
+// n - 1 threads.
+class ThreadPool {
+private:
+    vector<thread> workers;
+    mutex lock;
+    mutex runLock;  // one parallelFor() at a time
+    condition_variable wake;
+    condition_variable done;
+    
+    // Current loop; tasks are claimed one at a time under lock
+    const function<void(size_t)>* task;
+    size_t taskCount;
+    size_t nextTask;
+    size_t pending;
+    uint64_t generation;
+    bool stopping;
+    
+    void workerLoop();
+    void runTasks(unique_lock<mutex>& guard);
+    
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    size_t size() const { return workers.size() + 1; }
+    
+    // Runs body(0) .. body(count - 1) across the pool and returns once all
+    // of them have finished. Tasks should be coarse (e.g. one per thread).
+    void parallelFor(size_t count, const function<void(size_t)>& body);
+    
+    // Cores reported by the system, at least 1
+    static size_t hardwareThreads();
+};
+
+#endif // THREAD_POOL_H
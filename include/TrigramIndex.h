@@ -0,0 +1,100 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include "Buffer.h"
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Inverted index from every 3-byte sequence to the files directly inside a
+// directory that contain it, with the offsets where it occurs. Trigrams are
+// case-folded, so one index serves case-sensitive and insensitive queries.
+// Answers are candidates only: a file listed may still not match, and the
+// caller verifies it (see AdvancedSearchEngine::searchFiles).
+//
+// The index is kept in an append-only log inside the directory: every
+// (re)indexed or removed file appends one record and the last record for a
+// name wins, so saving one file never rewrites the whole index. The log is
+// compacted when most of it is superseded records.
+class TrigramIndex {
+private:
+    struct FileEntry {
+        string name;        // relative to the directory
+        uint64_t size;
+        int64_t modified;   // mtime when indexed
+        bool live;
+        bool indexed;       // false when too large: always a candidate
+        vector<uint32_t> trigrams;     // sorted, distinct
+        vector<uint32_t> offsetStart;  // trigrams[i] occurs at offsets[offsetStart[i] .. offsetStart[i + 1])
+        vector<uint32_t> offsets;
+        uint64_t recordBytes;          // size of its latest record in the log
+        
+        FileEntry() : size(0), modified(0), live(false), indexed(false), recordBytes(0) {}
+    };
+    
+    string directory;
+    string logPath;
+    vector<FileEntry> files;                               // file id -> entry
+    map<string, uint32_t> fileIds;                         // by name; removed files keep their id
+    size_t liveFiles;
+    unordered_map<uint32_t, vector<uint32_t>> postings;    // trigram -> sorted ids of live files
+    ofstream log;
+    uint64_t logSize;
+    uint64_t liveBytes;  // log bytes held by the latest record of each live file
+    static const uint64_t COMPACT_SLACK = 1 << 20;
+    
+    // Name relative to the directory, or "" if path is not directly inside it
+    string relativeName(const string& path) const;
+    uint32_t getFileId(const string& name);
+    
+    void indexText(FileEntry& entry, const BufferView& text) const;
+    void setEntry(uint32_t id, FileEntry& entry);  // replaces the file's entry and postings
+    
+    // Offsets of one trigram in a file; empty if it does not occur
+    pair<const uint32_t*, const uint32_t*> findOffsets(const FileEntry& entry, uint32_t trigram) const;
+    bool mayContain(const FileEntry& entry, const vector<pair<uint32_t, size_t>>& patternTrigrams) const;
+    
+    string encodeRecord(const FileEntry& entry) const;
+    bool decodeRecord(const string& record, FileEntry& entry) const;
+    bool appendRecord(const string& record);
+    bool loadLog();  // false if the log is missing or was not read to the end
+    bool compact();
+
+public:
+    static const char* const LOG_NAME;
+    // Larger files are not tokenized (offsets are 32-bit); they are always
+    // handed to the verifier
+    static const uint64_t MAX_INDEXED_SIZE = 256 << 20;
+    
+    explicit TrigramIndex(const string& dir = "data");
+    ~TrigramIndex();
+    TrigramIndex(const TrigramIndex&) = delete;
+    TrigramIndex& operator=(const TrigramIndex&) = delete;
+    
+    // Loads the log, then re-indexes files that were added or changed
+    // behind the index's back and forgets deleted ones
+    bool open();
+    size_t refresh();  // number of files (re)indexed or removed
+    
+    // Indexes the file from the given text (e.g. the buffer just saved
+    // to it) or from disk. False if the path is outside the directory.
+    bool updateFile(const string& path, const BufferView& text);
+    bool updateFile(const string& path);
+    void removeFile(const string& path);
+    
+    // Paths (directory/name) of files that may contain pattern. Patterns
+    // shorter than three bytes cannot be filtered and list every file.
+    vector<string> candidateFiles(const string& pattern) const;
+    
+    const string& getDirectory() const { return directory; }
+    size_t getFileCount() const { return liveFiles; }
+    size_t getTrigramCount() const { return postings.size(); }
+    uint64_t getLogSize() const { return logSize; }
+};
+
+#endif // TRIGRAM_INDEX_H
@@ -0,0 +1,55 @@
+#ifndef UNDO_SPILL_H
+#define UNDO_SPILL_H
+
+#include "Buffer.h"
+#include <fstream>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+// Append-only file under data/ that holds undo commands evicted from
+// memory. The file is deleted once no spilled command refers to it.
+class UndoSpillFile {
+private:
+    string path;
+    fstream file;
+    size_t endOffset;
+    
+public:
+    UndoSpillFile();
+    ~UndoSpillFile();
+    UndoSpillFile(const UndoSpillFile&) = delete;
+    UndoSpillFile& operator=(const UndoSpillFile&) = delete;
+    
+    bool isOpen() const { return file.is_open(); }
+    const string& getPath() const { return path; }
+    size_t getSize() const { return endOffset; }
+    
+    bool append(const string& record, size_t& offset);
+    bool read(size_t offset, size_t length, string& record);
+};
+
+// Stand-in for a command whose data lives in the spill file. prepare()
+// reads the real command back in; execute() or undo() applies it and
+// drops it again, so it never stays in memory.
+class SpilledCommand : public Command {
+private:
+    TextBuffer* buffer;
+    shared_ptr<UndoSpillFile> spillFile;
+    size_t offset;
+    size_t length;
+    shared_ptr<Command> loaded;  // set between prepare() and the step
+    
+public:
+    SpilledCommand(TextBuffer* buf, shared_ptr<UndoSpillFile> file, size_t off, size_t len);
+    
+    bool prepare() override;  // false if the record cannot be read
+    void execute() override;
+    void undo() override;
+    string getDescription() const override;
+    size_t memoryUsage() const override;
+    string serialize() const override;
+};
+
+#endif // UNDO_SPILL_H
@@ -20,12 +20,12 @@ private:
     string filename;  // Track which file this snapshot is from
     
 public:
-    VersionSnapshot(int versionId, const string& text, const string& desc = "", const string& file = "");
+    VersionSnapshot(int versionId, string text, const string& desc = "", const string& file = "");
     
     int getId() const { return id; }
     string getDescription() const { return description; }
     string getTimestamp() const { return timestamp; }
-    string getContent() const { return content; }
+    const string& getContent() const { return content; }
     string getFilename() const { return filename; }
     
     // Serialization
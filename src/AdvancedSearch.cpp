@@ -1,38 +1,222 @@
 #include "AdvancedSearch.h"
+#include "SimdScan.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <cctype>
 #include <ctime>
 #include <sstream>
 #include <iomanip>
+#include <queue>
 
 using namespace std;
 
-// ==================== AdvancedSearchEngine Implementation ====================
+// ==================== AhoCorasick Implementation ====================
 
-long long AdvancedSearchEngine::power(long long base, int exp) const {
-    long long result = 1;
-    for (int i = 0; i < exp; i++) {
-        result = (result * base) % PRIME;
+AhoCorasick::AhoCorasick(const vector<string>& patterns, bool caseSensitive) : alphabetSize(1) {
+    // Byte classes: one per distinct (folded) byte used by the patterns
+    for (int c = 0; c < 256; c++) {
+        byteClass[c] = 0;
+    }
+    for (const auto& pattern : patterns) {
+        for (unsigned char c : pattern) {
+            unsigned char folded = caseSensitive ? c : (unsigned char)tolower(c);
+            if (byteClass[folded] == 0) {
+                byteClass[folded] = alphabetSize++;
+            }
+        }
+    }
+    if (!caseSensitive) {
+        for (int c = 0; c < 256; c++) {
+            byteClass[c] = byteClass[(unsigned char)tolower(c)];
+        }
+    }
+    
+    // Trie; -1 marks a missing edge until the BFS below fills it in
+    transitions.assign(alphabetSize, -1);
+    vector<vector<size_t>> ownPatterns(1);
+    for (size_t i = 0; i < patterns.size(); i++) {
+        patternLengths.push_back(patterns[i].length());
+        if (patterns[i].empty()) continue;
+        
+        int state = 0;
+        for (unsigned char c : patterns[i]) {
+            int& next = transitions[state * alphabetSize + byteClass[c]];
+            if (next < 0) {
+                next = ownPatterns.size();
+                ownPatterns.push_back(vector<size_t>());
+                transitions.resize(transitions.size() + alphabetSize, -1);
+            }
+            state = transitions[state * alphabetSize + byteClass[c]];
+        }
+        ownPatterns[state].push_back(i);
+    }
+    
+    size_t stateCount = ownPatterns.size();
+    outputStart.assign(stateCount + 1, 0);
+    for (size_t s = 0; s < stateCount; s++) {
+        outputStart[s + 1] = outputStart[s] + ownPatterns[s].size();
+        outputs.insert(outputs.end(), ownPatterns[s].begin(), ownPatterns[s].end());
+    }
+    
+    // Breadth-first: fail links, then every missing edge is taken from the
+    // fail state so scanning never follows links
+    vector<int> fail(stateCount, 0);
+    outputLink.assign(stateCount, -1);
+    queue<int> pending;
+    for (size_t c = 0; c < alphabetSize; c++) {
+        int& next = transitions[c];
+        if (next < 0) {
+            next = 0;
+        } else {
+            pending.push(next);
+        }
+    }
+    while (!pending.empty()) {
+        int state = pending.front();
+        pending.pop();
+        
+        int link = fail[state];
+        outputLink[state] = (outputStart[link] != outputStart[link + 1]) ? link : outputLink[link];
+        
+        for (size_t c = 0; c < alphabetSize; c++) {
+            int& next = transitions[state * alphabetSize + c];
+            int viaFail = transitions[link * alphabetSize + c];
+            if (next < 0) {
+                next = viaFail;
+            } else {
+                fail[next] = viaFail;
+                pending.push(next);
+            }
+        }
     }
-    return result;
 }
 
-long long AdvancedSearchEngine::calculateHash(const string& str, int length) const {
-    long long hash = 0;
-    for (int i = 0; i < length && i < str.length(); i++) {
-        hash = (hash * BASE + static_cast<unsigned char>(str[i])) % PRIME;
+int AhoCorasick::scan(const char* data, size_t length, int state, size_t base,
+                      vector<Match>& matches) const {
+    for (size_t i = 0; i < length; i++) {
+        state = transitions[state * alphabetSize + byteClass[(unsigned char)data[i]]];
+        
+        for (int s = state; s > 0; s = outputLink[s]) {
+            for (size_t k = outputStart[s]; k < outputStart[s + 1]; k++) {
+                size_t idx = outputs[k];
+                matches.push_back(Match(base + i + 1 - patternLengths[idx], idx));
+            }
+        }
     }
-    return hash;
+    return state;
 }
 
-long long AdvancedSearchEngine::recalculateHash(long long oldHash, char oldChar, char newChar,
-                                               long long pow, int length) const {
-    long long newHash = (oldHash - (static_cast<unsigned char>(oldChar) * pow) % PRIME + PRIME) % PRIME;
-    newHash = (newHash * BASE + static_cast<unsigned char>(newChar)) % PRIME;
-    return newHash;
+// ==================== MyersMatcher Implementation ====================
+
+MyersMatcher::MyersMatcher(const string& pattern, bool caseSensitive)
+    : patternLength(pattern.length()), wordCount((pattern.length() + 63) / 64),
+      lastBit(0), score(0), anchored(false) {
+    peq.assign(256 * wordCount, 0);
+    for (size_t i = 0; i < patternLength; i++) {
+        unsigned char c = pattern[i];
+        uint64_t bit = (uint64_t)1 << (i % 64);
+        peq[c * wordCount + i / 64] |= bit;
+        if (!caseSensitive) {
+            peq[(unsigned char)tolower(c) * wordCount + i / 64] |= bit;
+            peq[(unsigned char)toupper(c) * wordCount + i / 64] |= bit;
+        }
+    }
+    if (patternLength > 0) {
+        lastBit = (uint64_t)1 << ((patternLength - 1) % 64);
+    }
+    reset(false);
+}
+
+void MyersMatcher::reset(bool anchoredStart) {
+    // First column is 0, 1, ..., m: every vertical delta is +1
+    anchored = anchoredStart;
+    pv.assign(wordCount, ~(uint64_t)0);
+    mv.assign(wordCount, 0);
+    score = patternLength;
+}
+
+void MyersMatcher::scan(const char* data, size_t length, size_t base, int maxDistance,
+                        vector<pair<size_t, int>>& ends) {
+    if (wordCount == 0) return;
+    
+    // Horizontal delta entering the top row: 0 when a match may start
+    // anywhere, +1 when the first row counts the bytes skipped
+    uint64_t topDelta = anchored ? 1 : 0;
+    
+    if (wordCount == 1) {
+        // Locals, so the compiler keeps the state in registers across push_back
+        const uint64_t* table = peq.data();
+        uint64_t Pv = pv[0];
+        uint64_t Mv = mv[0];
+        int current = score;
+        for (size_t j = 0; j < length; j++) {
+            uint64_t eq = table[(unsigned char)data[j]];
+            uint64_t xv = eq | Mv;
+            uint64_t xh = (((eq & Pv) + Pv) ^ Pv) | eq;
+            uint64_t ph = Mv | ~(xh | Pv);
+            uint64_t mh = Pv & xh;
+            current += (int)((ph & lastBit) != 0) - (int)((mh & lastBit) != 0);
+            ph = (ph << 1) | topDelta;
+            mh <<= 1;
+            Pv = mh | ~(xv | ph);
+            Mv = ph & xv;
+            
+            if (current <= maxDistance) {
+                ends.push_back(make_pair(base + j, current));
+            }
+        }
+        pv[0] = Pv;
+        mv[0] = Mv;
+        score = current;
+        return;
+    }
+    
+    const uint64_t highBit = (uint64_t)1 << 63;
+    const uint64_t* table = peq.data();
+    uint64_t* Pvs = pv.data();
+    uint64_t* Mvs = mv.data();
+    size_t words = wordCount;
+    int current = score;
+    for (size_t j = 0; j < length; j++) {
+        const uint64_t* eqs = table + (unsigned char)data[j] * words;
+        int carry = (int)topDelta;
+        for (size_t w = 0; w < words; w++) {
+            uint64_t eq = eqs[w];
+            uint64_t Pv = Pvs[w];
+            uint64_t Mv = Mvs[w];
+            uint64_t xv = eq | Mv;
+            if (carry < 0) eq |= 1;
+            uint64_t xh = (((eq & Pv) + Pv) ^ Pv) | eq;
+            uint64_t ph = Mv | ~(xh | Pv);
+            uint64_t mh = Pv & xh;
+            
+            uint64_t top = (w + 1 == words) ? lastBit : highBit;
+            int out = (ph & top) ? 1 : ((mh & top) ? -1 : 0);
+            ph <<= 1;
+            mh <<= 1;
+            if (carry < 0) {
+                mh |= 1;
+            } else if (carry > 0) {
+                ph |= 1;
+            }
+            Pvs[w] = mh | ~(xv | ph);
+            Mvs[w] = ph & xv;
+            carry = out;
+        }
+        current += carry;
+        
+        if (current <= maxDistance) {
+            ends.push_back(make_pair(base + j, current));
+        }
+    }
+    score = current;
 }
 
+// ==================== AdvancedSearchEngine Implementation ====================
+
 string AdvancedSearchEngine::toLowerCase(const string& str) const {
     string result = str;
     transform(result.begin(), result.end(), result.begin(), ::tolower);
@@ -43,22 +227,48 @@ bool AdvancedSearchEngine::isWordBoundary(char c) const {
     return !isalnum(c) && c != '_';
 }
 
-void AdvancedSearchEngine::getLineAndColumn(const string& text, size_t pos,
-                                           size_t& line, size_t& col) const {
-    line = 1;
-    col = 1;
+vector<size_t> AdvancedSearchEngine::buildLineStarts(const string& text, size_t threads,
+                                                     size_t end) const {
+    end = min(end, text.length());
+    vector<size_t> lineStarts(1, 0);
+    if (threads <= 1) {
+        for (size_t i = 0; i < end; i++) {
+            if (text[i] == '\n') {
+                lineStarts.push_back(i + 1);
+            }
+        }
+        return lineStarts;
+    }
     
-    for (size_t i = 0; i < pos && i < text.length(); i++) {
-        if (text[i] == '\n') {
-            line++;
-            col = 1;
-        } else {
-            col++;
+    vector<size_t> newlines = scanRanges(end, 1, threads,
+                                         [&](size_t start, size_t end, vector<size_t>& found) {
+        for (size_t i = start; i < end; i++) {
+            if (text[i] == '\n') {
+                found.push_back(i);
+            }
         }
+    });
+    for (size_t pos : newlines) {
+        lineStarts.push_back(pos + 1);
     }
+    return lineStarts;
+}
+
+void AdvancedSearchEngine::getLineAndColumn(const vector<size_t>& lineStarts, size_t pos,
+                                           size_t& line, size_t& col) const {
+    line = upper_bound(lineStarts.begin(), lineStarts.end(), pos) - lineStarts.begin();
+    col = pos - lineStarts[line - 1] + 1;
 }
 
-string AdvancedSearchEngine::getContext(const string& text, size_t pos, int contextLines) const {
+template <typename Text>
+bool AdvancedSearchEngine::isWholeWord(const Text& text, size_t pos, size_t length) const {
+    bool validStart = (pos == 0 || isWordBoundary(text[pos - 1]));
+    bool validEnd = (pos + length >= text.length() || isWordBoundary(text[pos + length]));
+    return validStart && validEnd;
+}
+
+template <typename Text>
+string AdvancedSearchEngine::getContext(const Text& text, size_t pos, int contextLines) const {
     // Find start of context (go back contextLines lines)
     size_t start = pos;
     int linesBack = 0;
@@ -87,28 +297,7 @@ string AdvancedSearchEngine::getContext(const string& text, size_t pos, int cont
 vector<size_t> AdvancedSearchEngine::rollingHashSearch(const string& text,
                                                        const string& pattern) const {
     vector<size_t> positions;
-    
-    if (pattern.empty() || pattern.length() > text.length()) {
-        return positions;
-    }
-    // ... Rabin-Karp implementation
-    int patternLen = pattern.length();
-    long long patternHash = calculateHash(pattern, patternLen);
-    long long textHash = calculateHash(text, patternLen);
-    long long pow = power(BASE, patternLen - 1);
-    
-    for (size_t i = 0; i <= text.length() - patternLen; i++) {
-        if (textHash == patternHash) {
-            if (text.substr(i, patternLen) == pattern) {
-                positions.push_back(i);
-            }
-        }
-        
-        if (i < text.length() - patternLen) {
-            textHash = recalculateHash(textHash, text[i], text[i + patternLen], pow, patternLen);
-        }
-    }
-    
+    findOccurrences(text.data(), text.length(), pattern, positions);
     return positions;
 }
 
@@ -136,67 +325,82 @@ vector<int> AdvancedSearchEngine::computeLPSArray(const string& pattern) const {
     return lps;
 }
 
-vector<size_t> AdvancedSearchEngine::kmpSearch(const string& text, const string& pattern) const {
-    vector<size_t> positions;
-    
+vector<size_t> AdvancedSearchEngine::kmpSearch(const string& text, const string& pattern,
+                                               bool caseSensitive) const {
     if (pattern.empty() || pattern.length() > text.length()) {
-        return positions;
+        return vector<size_t>();
     }
+    return kmpScan(text.begin(), text.end(), pattern, caseSensitive);
+}
+
+// KMP over any character iterator (e.g. a BufferView). Without case the LPS
+// table is built on the lowered pattern and each text byte is folded as it
+// is read, instead of lowercasing a copy of the text.
+template <typename Iterator>
+vector<size_t> AdvancedSearchEngine::kmpScan(Iterator begin, Iterator end, const string& pattern,
+                                             bool caseSensitive) const {
+    vector<size_t> positions;
+    string searchPattern = caseSensitive ? pattern : toLowerCase(pattern);
+    vector<int> lps = computeLPSArray(searchPattern);
+    int m = searchPattern.length();
     
-    vector<int> lps = computeLPSArray(pattern);
-    int n = text.length();
-    int m = pattern.length();
-    int i = 0;  // index for text
-    int j = 0;  // index for pattern
-    
-    while (i < n) {
-        if (pattern[j] == text[i]) {
-            i++;
+    int j = 0;
+    size_t i = 0;
+    for (Iterator it = begin; it != end; ++it, i++) {
+        char c = caseSensitive ? *it : (char)tolower((unsigned char)*it);
+        while (j > 0 && c != searchPattern[j]) {
+            j = lps[j - 1];
+        }
+        if (c == searchPattern[j]) {
             j++;
         }
-        
         if (j == m) {
-            positions.push_back(i - j);
+            positions.push_back(i + 1 - m);
             j = lps[j - 1];
-        } else if (i < n && pattern[j] != text[i]) {
-            if (j != 0) {
-                j = lps[j - 1];
-            } else {
-                i++;
-            }
         }
     }
     
     return positions;
 }
 
-vector<int> AdvancedSearchEngine::computeBadCharTable(const string& pattern) const {
+vector<int> AdvancedSearchEngine::computeBadCharTable(const string& pattern, bool caseSensitive) const {
     vector<int> badChar(256, -1);
     
+    // Without case both forms of a letter get its last index, so the raw
+    // text byte indexes the table
     for (int i = 0; i < pattern.length(); i++) {
-        badChar[(unsigned char)pattern[i]] = i;
+        unsigned char c = pattern[i];
+        if (caseSensitive) {
+            badChar[c] = i;
+        } else {
+            badChar[(unsigned char)tolower(c)] = i;
+            badChar[(unsigned char)toupper(c)] = i;
+        }
     }
     
     return badChar;
 }
 
-vector<size_t> AdvancedSearchEngine::boyerMooreSearch(const string& text,
-                                                      const string& pattern) const {
+vector<size_t> AdvancedSearchEngine::boyerMooreSearch(const string& text, const string& pattern,
+                                                      bool caseSensitive) const {
     vector<size_t> positions;
     
     if (pattern.empty() || pattern.length() > text.length()) {
         return positions;
     }
     
-    vector<int> badChar = computeBadCharTable(pattern);
+    string needle = caseSensitive ? pattern : toLowerCase(pattern);
+    vector<int> badChar = computeBadCharTable(needle, caseSensitive);
     int n = text.length();
-    int m = pattern.length();
+    int m = needle.length();
     int s = 0;  // shift
     
     while (s <= n - m) {
         int j = m - 1;
         
-        while (j >= 0 && pattern[j] == text[s + j]) {
+        while (j >= 0) {
+            char c = text[s + j];
+            if ((caseSensitive ? c : (char)tolower((unsigned char)c)) != needle[j]) break;
             j--;
         }
         
@@ -211,6 +415,150 @@ vector<size_t> AdvancedSearchEngine::boyerMooreSearch(const string& text,
     return positions;
 }
 
+vector<size_t> AdvancedSearchEngine::computeReverseShiftTable(const string& pattern) const {
+    // Distance to the leftmost occurrence of each byte in pattern[1..]
+    size_t m = pattern.length();
+    vector<size_t> shift(256, m);
+    for (size_t j = m; j-- > 1; ) {
+        shift[(unsigned char)pattern[j]] = j;
+    }
+    return shift;
+}
+
+// Mirror image of boyerMooreSearch: the window starts at the last position
+// before `before` and moves left. begin is a random-access iterator over
+// text, so a buffer view is read in place.
+template <typename Text, typename Iterator>
+size_t AdvancedSearchEngine::reverseSearch(const Text& text, Iterator begin, const string& pattern,
+                                           size_t before, const SearchOptions& options) const {
+    size_t m = pattern.length();
+    size_t n = text.length();
+    if (m == 0 || m > n || before == 0) {
+        return string::npos;
+    }
+    
+    bool caseSensitive = options.caseSensitive;
+    string needle = caseSensitive ? pattern : toLowerCase(pattern);
+    vector<size_t> shift = computeReverseShiftTable(needle);
+    
+    size_t s = min(before - 1, n - m);
+    Iterator window = begin + s;
+    while (true) {
+        size_t j = 0;
+        while (j < m) {
+            char c = window[j];
+            if ((caseSensitive ? c : (char)tolower((unsigned char)c)) != needle[j]) break;
+            j++;
+        }
+        if (j == m && (!options.wholeWord || isWholeWord(text, s, m))) {
+            return s;
+        }
+        
+        unsigned char first = *window;
+        size_t step = shift[caseSensitive ? first : (unsigned char)tolower(first)];
+        if (step > s) break;
+        s -= step;
+        window -= step;
+    }
+    return string::npos;
+}
+
+size_t AdvancedSearchEngine::requestedThreads(const SearchOptions& options) const {
+    return (options.threads == 0) ? ThreadPool::hardwareThreads() : options.threads;
+}
+
+ThreadPool& AdvancedSearchEngine::getPool(size_t threads) const {
+    if (!pool || pool->size() < threads) {
+        pool = make_shared<ThreadPool>(threads);
+    }
+    return *pool;
+}
+
+// Range r covers [length * r / ranges, length * (r + 1) / ranges) and is
+// scanned m - 1 bytes further, so a match across the cut is found by the
+// range it starts in and dropped by the next. Each range's positions are
+// sorted, so concatenating them in order keeps the result sorted.
+template <typename Scan>
+vector<size_t> AdvancedSearchEngine::scanRanges(size_t length, size_t m, size_t ranges, Scan scan) const {
+    vector<vector<size_t>> found(ranges);
+    getPool(ranges).parallelFor(ranges, [&](size_t r) {
+        size_t start = length * r / ranges;
+        size_t end = length * (r + 1) / ranges;
+        scan(start, min(length, end + m - 1), found[r]);
+        found[r].erase(lower_bound(found[r].begin(), found[r].end(), end), found[r].end());
+    });
+    
+    vector<size_t> positions;
+    for (auto& part : found) {
+        positions.insert(positions.end(), part.begin(), part.end());
+        vector<size_t>().swap(part);
+    }
+    return positions;
+}
+
+// Whole-word filter, line/column and context for each match, split into
+// contiguous slices of the match list when there are enough of them
+template <typename Text, typename Locate>
+vector<SearchResult> AdvancedSearchEngine::buildResults(const Text& text, const vector<Regex::Match>& matches,
+                                                        const SearchOptions& options, Locate locate) const {
+    // With a cap, annotate in search order and stop when it is reached
+    if (options.maxResults > 0) {
+        vector<SearchResult> results;
+        for (size_t i = 0; i < matches.size() && results.size() < options.maxResults; i++) {
+            const Regex::Match& match = matches[options.searchBackward ? matches.size() - 1 - i : i];
+            if (options.wholeWord && !isWholeWord(text, match.position, match.length)) {
+                continue;
+            }
+            
+            size_t line, col;
+            locate(match.position, line, col);
+            results.push_back(SearchResult(match.position, line, col,
+                                           getContext(text, match.position, options.contextLines),
+                                           match.length));
+        }
+        return results;
+    }
+    
+    size_t parts = max((size_t)1, min(requestedThreads(options), matches.size() / MIN_PARALLEL_RESULTS));
+    vector<vector<SearchResult>> built(parts);
+    auto annotate = [&](size_t p) {
+        size_t first = matches.size() * p / parts;
+        size_t last = matches.size() * (p + 1) / parts;
+        for (size_t i = first; i < last; i++) {
+            const Regex::Match& match = matches[i];
+            if (options.wholeWord && !isWholeWord(text, match.position, match.length)) {
+                continue;
+            }
+            
+            size_t line, col;
+            locate(match.position, line, col);
+            string context = getContext(text, match.position, options.contextLines);
+            
+            built[p].push_back(SearchResult(match.position, line, col, context, match.length));
+        }
+    };
+    if (parts == 1) {
+        annotate(0);
+    } else {
+        getPool(parts).parallelFor(parts, annotate);
+    }
+    
+    vector<SearchResult> results;
+    if (parts == 1) {
+        results.swap(built[0]);
+    } else {
+        for (auto& part : built) {
+            results.insert(results.end(), make_move_iterator(part.begin()), make_move_iterator(part.end()));
+            vector<SearchResult>().swap(part);
+        }
+    }
+    
+    if (options.searchBackward) {
+        reverse(results.begin(), results.end());
+    }
+    return results;
+}
+
 vector<SearchResult> AdvancedSearchEngine::search(const string& text, const string& pattern,
                                                   const SearchOptions& options) const {
     vector<SearchResult> results;
@@ -219,45 +567,665 @@ vector<SearchResult> AdvancedSearchEngine::search(const string& text, const stri
         return results;
     }
     
-    string searchText = text;
-    string searchPattern = pattern;
+    size_t threads = min(requestedThreads(options), max((size_t)1, text.length() / MIN_PARALLEL_LENGTH));
+    size_t cap = options.maxResults;
+    vector<Regex::Match> matches;  // with a cap: only those kept, in search order
+    auto keep = [&](size_t pos, size_t length) {
+        if (!options.wholeWord || isWholeWord(text, pos, length)) {
+            matches.push_back(Regex::Match(pos, length));
+        }
+    };
+    auto scan = [&](size_t start, size_t end, vector<size_t>& found) {
+        if (options.caseSensitive) {
+            findOccurrences(text.data() + start, end - start, pattern, found, start);
+        } else {
+            findOccurrencesIgnoreCase(text.data() + start, end - start, pattern, found, start);
+        }
+    };
+    
+    if (options.useRegex) {
+        shared_ptr<Regex> regex = getRegex(pattern, options.caseSensitive);
+        if (!regex) {
+            return results;
+        }
+        matches = regex->findAll(text);
+        if (cap > 0) {
+            vector<Regex::Match> found;
+            found.swap(matches);
+            for (size_t i = 0; i < found.size() && matches.size() < cap; i++) {
+                const Regex::Match& match = found[options.searchBackward ? found.size() - 1 - i : i];
+                keep(match.position, match.length);
+            }
+        }
+    } else if (cap > 0) {
+        // A block at a time in search order, stopping once cap are kept.
+        // Blocks overlap by m - 1 bytes; a match belongs to the block it starts in.
+        size_t n = text.length();
+        size_t m = pattern.length();
+        size_t blockSize = CAPPED_BLOCK_SIZE;  // local copy, so min() does not odr-use the constant
+        size_t scanned = options.searchBackward ? n : 0;
+        bool exhausted = false;
+        while (matches.size() < cap && !exhausted) {
+            size_t start, end;
+            if (options.searchBackward) {
+                start = scanned - min(scanned, blockSize);
+                end = scanned;
+                scanned = start;
+                exhausted = (start == 0);
+            } else {
+                start = scanned;
+                end = min(n, scanned + blockSize);
+                scanned = end;
+                exhausted = (end == n);
+            }
+            
+            vector<size_t> found;
+            scan(start, min(n, end + m - 1), found);
+            found.erase(lower_bound(found.begin(), found.end(), end), found.end());
+            if (options.searchBackward) {
+                reverse(found.begin(), found.end());
+            }
+            for (size_t i = 0; i < found.size() && matches.size() < cap; i++) {
+                keep(found[i], m);
+            }
+        }
+    } else {
+        vector<size_t> positions;
+        if (threads > 1) {
+            positions = scanRanges(text.length(), pattern.length(), threads, scan);
+        } else {
+            scan(0, text.length(), positions);
+        }
+        for (size_t pos : positions) {
+            matches.push_back(Regex::Match(pos, pattern.length()));
+        }
+    }
+    
+    if (cap > 0) {
+        // buildResults takes the matches in text order; lines are counted
+        // only as far as the furthest one kept
+        if (options.searchBackward) {
+            reverse(matches.begin(), matches.end());
+        }
+        size_t furthest = matches.empty() ? 0 : matches.back().position;
+        vector<size_t> lineStarts = buildLineStarts(text, threads, furthest);
+        return buildResults(text, matches, options, [&](size_t pos, size_t& line, size_t& col) {
+            getLineAndColumn(lineStarts, pos, line, col);
+        });
+    }
     
-    // Handle case sensitivity
-    if (!options.caseSensitive) {
-        searchText = toLowerCase(text);
-        searchPattern = toLowerCase(pattern);
+    vector<size_t> lineStarts = buildLineStarts(text, threads);
+    return buildResults(text, matches, options, [&](size_t pos, size_t& line, size_t& col) {
+        getLineAndColumn(lineStarts, pos, line, col);
+    });
+}
+
+vector<SearchResult> AdvancedSearchEngine::search(const TextBuffer& buffer, const string& pattern,
+                                                  const SearchOptions& options) const {
+    return searchBuffer(buffer, pattern, options, true);
+}
+
+SearchCursor AdvancedSearchEngine::openSearch(const TextBuffer& buffer, const string& pattern,
+                                              const SearchOptions& options) const {
+    shared_ptr<Regex> regex;
+    if (options.useRegex && !pattern.empty()) {
+        regex = getRegex(pattern, options.caseSensitive);
+    }
+    return SearchCursor(this, buffer, pattern, options, regex);
+}
+
+vector<SearchResult> AdvancedSearchEngine::searchBuffer(const TextBuffer& buffer, const string& pattern,
+                                                        const SearchOptions& options, bool useIndex) const {
+    vector<SearchResult> results;
+    
+    if (pattern.empty()) {
+        return results;
     }
     
-    // Use KMP search for better performance
-    vector<size_t> positions = kmpSearch(searchText, searchPattern);
+    // A capped search reads only as many results as it keeps
+    if (options.maxResults > 0) {
+        SearchCursor cursor = openSearch(buffer, pattern, options);
+        SearchResult result(0, 0, 0, "");
+        while (cursor.next(result)) {
+            result.context = cursor.getContext(result);
+            results.push_back(result);
+        }
+        return results;
+    }
     
-    // Filter for whole word if needed
-    if (options.wholeWord) {
-        vector<size_t> filteredPositions;
+    BufferView view = buffer.getView();
+    size_t threads = min(requestedThreads(options), max((size_t)1, view.length() / MIN_PARALLEL_LENGTH));
+    vector<Regex::Match> matches;
+    if (options.useRegex) {
+        shared_ptr<Regex> regex = getRegex(pattern, options.caseSensitive);
+        if (!regex) {
+            return results;
+        }
+        matches = regex->findAll(view);
+    } else {
+        vector<size_t> positions;
+        if (options.caseSensitive && useIndex && (threads == 1 || index.isCurrent(buffer))) {
+            positions = findAll(buffer, pattern);
+        } else if (threads > 1) {
+            // Each range scans its own slice of the spans in place
+            positions = scanRanges(view.length(), pattern.length(), threads,
+                                   [&](size_t start, size_t end, vector<size_t>& found) {
+                BufferView slice = view.subview(start, end - start);
+                if (options.caseSensitive) {
+                    findOccurrences(slice, pattern, found);
+                } else {
+                    findOccurrencesIgnoreCase(slice, pattern, found);
+                }
+                for (size_t& pos : found) {
+                    pos += start;
+                }
+            });
+        } else if (options.caseSensitive) {
+            findOccurrences(view, pattern, positions);
+        } else {
+            findOccurrencesIgnoreCase(view, pattern, positions);
+        }
         for (size_t pos : positions) {
-            bool validStart = (pos == 0 || isWordBoundary(text[pos - 1]));
-            bool validEnd = (pos + pattern.length() >= text.length() ||
-                           isWordBoundary(text[pos + pattern.length()]));
-            
-            if (validStart && validEnd) {
-                filteredPositions.push_back(pos);
+            matches.push_back(Regex::Match(pos, pattern.length()));
+        }
+    }
+    
+    // The buffer builds its line index lazily; do that here so the
+    // annotating threads only read it
+    size_t lastLine, lastCol;
+    buffer.getLineAndColumn(view.length(), lastLine, lastCol);
+    return buildResults(view, matches, options, [&](size_t pos, size_t& line, size_t& col) {
+        buffer.getLineAndColumn(pos, line, col);
+    });
+}
+
+vector<size_t> AdvancedSearchEngine::findAll(const TextBuffer& buffer, const string& pattern) const {
+    if (index.isCurrent(buffer)) {
+        return index.find(pattern);
+    }
+    
+    if (indexing && buffer.length() <= MAX_INDEXED_LENGTH) {
+        if (buffer.getVersion() != scannedVersion) {
+            scannedVersion = buffer.getVersion();
+            scansOfVersion = 0;
+            index.clear();  // stale, and large
+        }
+        if (++scansOfVersion >= INDEX_AFTER_SEARCHES && index.build(buffer)) {
+            return index.find(pattern);
+        }
+    }
+    
+    vector<size_t> positions;
+    findOccurrences(buffer.getView(), pattern, positions);
+    return positions;
+}
+
+vector<FileSearchResult> AdvancedSearchEngine::searchFiles(const TrigramIndex& files, const string& pattern,
+                                                           const SearchOptions& options) const {
+    vector<FileSearchResult> found;
+    if (pattern.empty()) {
+        return found;
+    }
+    
+    // A regular expression has no literal the trigrams could require
+    vector<string> candidates = files.candidateFiles(options.useRegex ? "" : pattern);
+    for (const string& path : candidates) {
+        TextBuffer buffer;
+        auto mapped = make_shared<MappedFile>();
+        if (mapped->open(path)) {
+            buffer.setMappedText(mapped);
+        } else {
+            ifstream file(path, ios::binary);
+            if (!file.is_open()) continue;
+            stringstream ss;
+            ss << file.rdbuf();
+            buffer.setText(ss.str());
+        }
+        
+        vector<SearchResult> results = searchBuffer(buffer, pattern, options, false);
+        if (!results.empty()) {
+            found.push_back(FileSearchResult(path));
+            found.back().results = move(results);
+        }
+    }
+    return found;
+}
+
+void AdvancedSearchEngine::setIndexing(bool enabled) {
+    indexing = enabled;
+    if (!enabled) {
+        index.clear();
+        scansOfVersion = 0;
+    }
+}
+
+bool AdvancedSearchEngine::findPrevious(const string& text, const string& pattern, size_t before,
+                                       const SearchOptions& options, SearchResult& result,
+                                       const vector<size_t>* lineStarts) const {
+    size_t pos = string::npos;
+    size_t length = pattern.length();
+    if (options.useRegex) {
+        shared_ptr<Regex> regex = getRegex(pattern, options.caseSensitive);
+        if (!regex) {
+            return false;
+        }
+        // The lazy DFA only runs forward; keep the last match that qualifies
+        for (const auto& match : regex->findAll(text)) {
+            if (match.position >= before) break;
+            if (!options.wholeWord || isWholeWord(text, match.position, match.length)) {
+                pos = match.position;
+                length = match.length;
             }
         }
-        positions = filteredPositions;
+    } else {
+        pos = reverseSearch(text, text.begin(), pattern, before, options);
+    }
+    if (pos == string::npos) {
+        return false;
     }
     
-    // Create SearchResult objects
-    for (size_t pos : positions) {
+    size_t line, col;
+    if (lineStarts) {
+        getLineAndColumn(*lineStarts, pos, line, col);
+    } else {
+        size_t lineStart = (pos == 0) ? string::npos : text.rfind('\n', pos - 1);
+        lineStart = (lineStart == string::npos) ? 0 : lineStart + 1;
+        line = countNewlines(text.data(), lineStart) + 1;
+        col = pos - lineStart + 1;
+    }
+    result = SearchResult(pos, line, col, getContext(text, pos, options.contextLines), length);
+    return true;
+}
+
+bool AdvancedSearchEngine::findPrevious(const TextBuffer& buffer, const string& pattern, size_t before,
+                                       const SearchOptions& options, SearchResult& result) const {
+    BufferView view = buffer.getView();
+    size_t pos = string::npos;
+    size_t length = pattern.length();
+    if (options.useRegex) {
+        shared_ptr<Regex> regex = getRegex(pattern, options.caseSensitive);
+        if (!regex) {
+            return false;
+        }
+        for (const auto& match : regex->findAll(view)) {
+            if (match.position >= before) break;
+            if (!options.wholeWord || isWholeWord(view, match.position, match.length)) {
+                pos = match.position;
+                length = match.length;
+            }
+        }
+    } else {
+        pos = reverseSearch(view, view.begin(), pattern, before, options);
+    }
+    if (pos == string::npos) {
+        return false;
+    }
+    
+    size_t line, col;
+    buffer.getLineAndColumn(pos, line, col);
+    result = SearchResult(pos, line, col, getContext(view, pos, options.contextLines), length);
+    return true;
+}
+
+vector<AdvancedSearchEngine::FuzzyMatch> AdvancedSearchEngine::fuzzyScan(
+        const BufferView& view, const string& pattern, int maxDistance, bool caseSensitive) const {
+    vector<FuzzyMatch> matches;
+    size_t m = pattern.length();
+    if (m == 0 || maxDistance < 0) {
+        return matches;
+    }
+    // Every match keeps at least one character of the pattern
+    size_t k = min((size_t)maxDistance, m - 1);
+    size_t n = view.length();
+    
+    // Split the pattern into k + 1 pieces: k edits can break at most k of
+    // them, so every match contains one piece verbatim. Only the text around
+    // exact piece hits (found with the SIMD scan) then needs the matcher.
+    vector<pair<size_t, size_t>> regions;
+    size_t pieceLength = m / (k + 1);
+    if (pieceLength >= MIN_FUZZY_PIECE) {
+        vector<pair<size_t, size_t>> windows;
+        for (size_t i = 0; i <= k; i++) {
+            size_t offset = i * pieceLength;
+            vector<size_t> hits;
+            if (caseSensitive) {
+                findOccurrences(view, pattern.substr(offset, pieceLength), hits);
+            } else {
+                findOccurrencesIgnoreCase(view, pattern.substr(offset, pieceLength), hits);
+            }
+            for (size_t q : hits) {
+                // Wide enough for every end such a match can have, plus the
+                // m + k bytes before it the matcher needs to be exact
+                size_t from = (q >= offset + 3 * k) ? q - offset - 3 * k : 0;
+                windows.push_back(make_pair(from, min(n, q + m + 2 * k + 1 - offset)));
+            }
+        }
+        sort(windows.begin(), windows.end());
+        for (const auto& window : windows) {
+            if (!regions.empty() && window.first <= regions.back().second) {
+                regions.back().second = max(regions.back().second, window.second);
+            } else {
+                regions.push_back(window);
+            }
+        }
+    } else if (n > 0) {
+        regions.push_back(make_pair((size_t)0, n));
+    }
+    
+    // Ends of matches with their distance, in text order
+    MyersMatcher forward(pattern, caseSensitive);
+    vector<pair<size_t, int>> ends;
+    for (const auto& region : regions) {
+        forward.reset(false);
+        size_t s = view.findSpan(region.first);
+        for (size_t pos = region.first; pos < region.second; s++) {
+            const TextSpan& span = view.getSpan(s);
+            size_t offset = pos - view.getSpanOffset(s);
+            size_t take = min(span.length - offset, region.second - pos);
+            forward.scan(span.data + offset, take, pos, (int)k, ends);
+            pos += take;
+        }
+    }
+    
+    // The start is found by matching the reversed pattern, anchored at the
+    // end, against the text read backwards; the shortest such match wins.
+    // Overlapping candidates compete: fewest edits, then longest.
+    MyersMatcher backward(string(pattern.rbegin(), pattern.rend()), caseSensitive);
+    for (const auto& found : ends) {
+        size_t end = found.first;
+        int distance = found.second;
+        
+        size_t windowStart = end + 1 - min(end + 1, m + k);
+        string window = view.substr(windowStart, end + 1 - windowStart);
+        reverse(window.begin(), window.end());
+        vector<pair<size_t, int>> starts;
+        backward.reset(true);
+        backward.scan(window.data(), window.length(), 0, distance, starts);
+        if (starts.empty()) continue;
+        
+        FuzzyMatch candidate(end - starts[0].first, starts[0].first + 1, distance);
+        if (!matches.empty() && candidate.position < matches.back().position + matches.back().length) {
+            FuzzyMatch& best = matches.back();
+            if (candidate.distance < best.distance ||
+                (candidate.distance == best.distance && candidate.length > best.length)) {
+                best = candidate;
+            }
+        } else {
+            matches.push_back(candidate);
+        }
+    }
+    
+    return matches;
+}
+
+int AdvancedSearchEngine::editDistance(const string& a, const string& b) const {
+    if (a.empty()) {
+        return b.length();
+    }
+    MyersMatcher matcher(a);
+    matcher.reset(true);
+    vector<pair<size_t, int>> unused;
+    matcher.scan(b.data(), b.length(), 0, -1, unused);
+    return matcher.getScore();
+}
+
+vector<SearchResult> AdvancedSearchEngine::fuzzySearch(const string& text, const string& pattern,
+                                                       int maxDistance, const SearchOptions& options) const {
+    vector<SearchResult> results;
+    vector<size_t> lineStarts;
+    for (const auto& match : fuzzyScan(BufferView(text), pattern, maxDistance, options.caseSensitive)) {
+        if (options.wholeWord && !isWholeWord(text, match.position, match.length)) {
+            continue;
+        }
+        
+        if (lineStarts.empty()) {
+            lineStarts = buildLineStarts(text);
+        }
+        size_t line, col;
+        getLineAndColumn(lineStarts, match.position, line, col);
+        results.push_back(SearchResult(match.position, line, col,
+                                       getContext(text, match.position, options.contextLines),
+                                       match.length));
+        results.back().distance = match.distance;
+    }
+    
+    if (options.searchBackward) {
+        reverse(results.begin(), results.end());
+    }
+    return results;
+}
+
+vector<SearchResult> AdvancedSearchEngine::fuzzySearch(const TextBuffer& buffer, const string& pattern,
+                                                       int maxDistance, const SearchOptions& options) const {
+    vector<SearchResult> results;
+    BufferView view = buffer.getView();
+    for (const auto& match : fuzzyScan(view, pattern, maxDistance, options.caseSensitive)) {
+        if (options.wholeWord && !isWholeWord(view, match.position, match.length)) {
+            continue;
+        }
+        
+        size_t line, col;
+        buffer.getLineAndColumn(match.position, line, col);
+        results.push_back(SearchResult(match.position, line, col,
+                                       getContext(view, match.position, options.contextLines),
+                                       match.length));
+        results.back().distance = match.distance;
+    }
+    
+    if (options.searchBackward) {
+        reverse(results.begin(), results.end());
+    }
+    return results;
+}
+
+vector<size_t> AdvancedSearchEngine::fuzzySearch(const string& text, const string& pattern,
+                                                 int maxDistance) const {
+    vector<size_t> positions;
+    for (const auto& match : fuzzyScan(BufferView(text), pattern, maxDistance, true)) {
+        positions.push_back(match.position);
+    }
+    return positions;
+}
+
+shared_ptr<Regex> AdvancedSearchEngine::getRegex(const string& pattern, bool caseSensitive,
+                                                 string* error) const {
+    pair<string, bool> key(pattern, caseSensitive);
+    auto found = regexCache.find(key);
+    if (found != regexCache.end()) {
+        return found->second;
+    }
+    
+    shared_ptr<Regex> regex = Regex::compile(pattern, caseSensitive, error);
+    if (regex) {
+        if (regexCache.size() >= MAX_CACHED_REGEXES) {
+            regexCache.clear();
+        }
+        regexCache[key] = regex;
+    }
+    return regex;
+}
+
+bool AdvancedSearchEngine::isValidRegex(const string& pattern, string* error) const {
+    return getRegex(pattern, true, error) != nullptr;
+}
+
+static bool matchBefore(const AhoCorasick::Match& a, const AhoCorasick::Match& b) {
+    return a.position != b.position ? a.position < b.position : a.patternIndex < b.patternIndex;
+}
+
+vector<SearchResult> AdvancedSearchEngine::multiPatternSearch(const string& text,
+                                                              const vector<string>& patterns,
+                                                              const SearchOptions& options) const {
+    AhoCorasick automaton(patterns, options.caseSensitive);
+    vector<AhoCorasick::Match> matches;
+    automaton.scan(text.data(), text.length(), 0, 0, matches);
+    sort(matches.begin(), matches.end(), matchBefore);
+    
+    vector<SearchResult> results;
+    vector<size_t> lineStarts = buildLineStarts(text);
+    for (const auto& match : matches) {
+        if (options.wholeWord && !isWholeWord(text, match.position, patterns[match.patternIndex].length())) {
+            continue;
+        }
+        
         size_t line, col;
-        getLineAndColumn(text, pos, line, col);
-        string context = getContext(text, pos, options.contextLines);
+        getLineAndColumn(lineStarts, match.position, line, col);
+        results.push_back(SearchResult(match.position, line, col,
+                                       getContext(text, match.position, options.contextLines),
+                                       patterns[match.patternIndex].length(), match.patternIndex));
+    }
+    
+    return results;
+}
+
+vector<SearchResult> AdvancedSearchEngine::multiPatternSearch(const TextBuffer& buffer,
+                                                              const vector<string>& patterns,
+                                                              const SearchOptions& options) const {
+    AhoCorasick automaton(patterns, options.caseSensitive);
+    BufferView view = buffer.getView();
+    
+    // The automaton state carries over from one span to the next
+    vector<AhoCorasick::Match> matches;
+    int state = 0;
+    for (size_t s = 0; s < view.getSpanCount(); s++) {
+        const TextSpan& span = view.getSpan(s);
+        state = automaton.scan(span.data, span.length, state, view.getSpanOffset(s), matches);
+    }
+    sort(matches.begin(), matches.end(), matchBefore);
+    
+    vector<SearchResult> results;
+    for (const auto& match : matches) {
+        if (options.wholeWord && !isWholeWord(view, match.position, patterns[match.patternIndex].length())) {
+            continue;
+        }
         
-        results.push_back(SearchResult(pos, line, col, context));
+        size_t line, col;
+        buffer.getLineAndColumn(match.position, line, col);
+        results.push_back(SearchResult(match.position, line, col,
+                                       getContext(view, match.position, options.contextLines),
+                                       patterns[match.patternIndex].length(), match.patternIndex));
     }
     
     return results;
 }
 
+vector<pair<string, vector<size_t>>> AdvancedSearchEngine::multiPatternSearch(
+        const string& text, const vector<string>& patterns) const {
+    vector<pair<string, vector<size_t>>> results;
+    for (const auto& pattern : patterns) {
+        results.push_back(make_pair(pattern, vector<size_t>()));
+    }
+    
+    AhoCorasick automaton(patterns);
+    vector<AhoCorasick::Match> matches;
+    automaton.scan(text.data(), text.length(), 0, 0, matches);
+    sort(matches.begin(), matches.end(), matchBefore);
+    
+    for (const auto& match : matches) {
+        results[match.patternIndex].second.push_back(match.position);
+    }
+    return results;
+}
+
+
+// ==================== SearchCursor Implementation ====================
+
+SearchCursor::SearchCursor(const AdvancedSearchEngine* eng, const TextBuffer& buf, const string& pat,
+                           const SearchOptions& opts, shared_ptr<Regex> compiled)
+    : engine(eng), buffer(&buf), version(buf.getVersion()), view(buf.getView()), pattern(pat),
+      options(opts), regex(move(compiled)), pendingNext(0), returned(0) {
+    scanned = options.searchBackward ? view.length() : 0;
+    exhausted = pattern.empty() || (options.useRegex && !regex) ||
+                (!options.useRegex && pattern.length() > view.length());
+}
+
+bool SearchCursor::refill() {
+    pending.clear();
+    pendingNext = 0;
+    if (exhausted) return false;
+    
+    if (regex) {
+        pending = regex->findAll(view);
+        if (options.searchBackward) {
+            reverse(pending.begin(), pending.end());
+        }
+        exhausted = true;
+        return !pending.empty();
+    }
+    
+    // Blocks overlap by m - 1 bytes; a match belongs to the block it starts in
+    size_t n = view.length();
+    size_t m = pattern.length();
+    size_t blockSize = BLOCK_SIZE;  // local copy, so min() does not odr-use the constant
+    vector<size_t> positions;
+    while (positions.empty() && !exhausted) {
+        size_t start, end;
+        if (options.searchBackward) {
+            start = scanned - min(scanned, blockSize);
+            end = scanned;
+            scanned = start;
+            exhausted = (start == 0);
+        } else {
+            start = scanned;
+            end = min(n, scanned + blockSize);
+            scanned = end;
+            exhausted = (end == n);
+        }
+        
+        BufferView slice = view.subview(start, min(n, end + m - 1) - start);
+        if (options.caseSensitive) {
+            findOccurrences(slice, pattern, positions);
+        } else {
+            findOccurrencesIgnoreCase(slice, pattern, positions);
+        }
+        positions.erase(lower_bound(positions.begin(), positions.end(), end - start), positions.end());
+        for (size_t& pos : positions) {
+            pos += start;
+        }
+    }
+    
+    if (options.searchBackward) {
+        reverse(positions.begin(), positions.end());
+    }
+    for (size_t pos : positions) {
+        pending.push_back(Regex::Match(pos, m));
+    }
+    return !pending.empty();
+}
+
+bool SearchCursor::next(SearchResult& result) {
+    while (isValid() && (options.maxResults == 0 || returned < options.maxResults)) {
+        if (pendingNext == pending.size() && !refill()) {
+            return false;
+        }
+        
+        const Regex::Match& match = pending[pendingNext++];
+        if (options.wholeWord && !engine->isWholeWord(view, match.position, match.length)) {
+            continue;
+        }
+        
+        size_t line, col;
+        buffer->getLineAndColumn(match.position, line, col);
+        result = SearchResult(match.position, line, col, "", match.length);
+        returned++;
+        return true;
+    }
+    return false;
+}
+
+vector<SearchResult> SearchCursor::nextPage(size_t count) {
+    vector<SearchResult> page;
+    SearchResult result(0, 0, 0, "");
+    while (page.size() < count && next(result)) {
+        page.push_back(result);
+    }
+    return page;
+}
+
+string SearchCursor::getContext(const SearchResult& result) const {
+    if (!isValid()) return "";
+    return engine->getContext(view, result.position, options.contextLines);
+}
 
 // ==================== SearchHistory Implementation ====================
 
@@ -1,10 +1,28 @@
 #include "Buffer.h"
+#include "PieceTable.h"
+#include "Rope.h"
+#include "MappedFile.h"
+#include "UndoSpill.h"
+#include "SimdScan.h"
+#include "TrigramIndex.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <iterator>
 #include <fstream>
+#include <cstdio>
+#include <atomic>
 #include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
 #include <direct.h>  // For Windows _mkdir
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <climits>
+#endif
 
 using namespace std;
 
@@ -21,201 +39,855 @@ void ensureDataFolderExists() {
     }
 }
 
-// ==================== TextBuffer Implementation ====================
+#ifndef _WIN32
+// writev() every iovec in the batch, resuming after partial writes
+static bool writeAll(int fd, vector<iovec>& batch) {
+    size_t first = 0;
+    while (first < batch.size()) {
+        ssize_t written = writev(fd, &batch[first], min(batch.size() - first, (size_t)IOV_MAX));
+        if (written < 0) return false;
+        
+        size_t remaining = written;
+        while (first < batch.size() && remaining >= batch[first].iov_len) {
+            remaining -= batch[first].iov_len;
+            first++;
+        }
+        if (remaining > 0) {
+            batch[first].iov_base = static_cast<char*>(batch[first].iov_base) + remaining;
+            batch[first].iov_len -= remaining;
+        }
+    }
+    batch.clear();
+    return true;
+}
+#endif
 
-TextBuffer::TextBuffer() : totalLength(0) {
-    chunks.push_back("");
+// Stream the view's spans to a temp file next to path, flush it to disk and
+// rename it over path, so a crash never leaves a truncated file behind.
+// Extra memory stays constant: the spans are written where they live.
+static bool writeFileAtomically(const string& path, const BufferView& view) {
+    string tempPath = path + ".tmp";
+    
+#ifdef _WIN32
+    {
+        ofstream file(tempPath);
+        if (!file.is_open()) return false;
+        
+        for (size_t i = 0; i < view.getSpanCount(); i++) {
+            file.write(view.getSpan(i).data, view.getSpan(i).length);
+        }
+        file.flush();
+        if (!file) {
+            file.close();
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+    
+    if (!MoveFileExA(tempPath.c_str(), path.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+#else
+    // Keep the permissions of the file being replaced
+    struct stat info;
+    mode_t mode = (stat(path.c_str(), &info) == 0) ? (info.st_mode & 07777) : 0644;
+    
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd < 0) return false;
+    
+    const size_t BATCH_SIZE = 1024;
+    vector<iovec> batch;
+    batch.reserve(BATCH_SIZE);
+    
+    bool ok = true;
+    for (size_t i = 0; ok && i < view.getSpanCount(); i++) {
+        iovec span;
+        span.iov_base = const_cast<char*>(view.getSpan(i).data);
+        span.iov_len = view.getSpan(i).length;
+        batch.push_back(span);
+        
+        if (batch.size() == BATCH_SIZE) {
+            ok = writeAll(fd, batch);
+        }
+    }
+    
+    ok = ok && writeAll(fd, batch) && fsync(fd) == 0;
+    ok = (close(fd) == 0) && ok;
+    ok = ok && rename(tempPath.c_str(), path.c_str()) == 0;
+    
+    if (!ok) {
+        unlink(tempPath.c_str());
+    }
+    return ok;
+#endif
 }
 
-TextBuffer::TextBuffer(const string& text) : totalLength(0) {
-    setText(text);
+// ==================== BufferView Implementation ====================
+
+BufferView::BufferView() : totalLength(0) {}
+
+BufferView::BufferView(const string& text) : totalLength(0) {
+    if (!text.empty()) {
+        spans.push_back(TextSpan(text.data(), text.length()));
+        offsets.push_back(0);
+        totalLength = text.length();
+    }
 }
 
-void TextBuffer::setText(const string& text) {
-    chunks.clear();
-    totalLength = 0;
+BufferView::BufferView(const vector<TextSpan>& textSpans) : totalLength(0) {
+    spans.reserve(textSpans.size());
+    offsets.reserve(textSpans.size());
+    for (const auto& span : textSpans) {
+        if (span.length == 0) continue;  // iterators rely on non-empty spans
+        spans.push_back(span);
+        offsets.push_back(totalLength);
+        totalLength += span.length;
+    }
+}
+
+size_t BufferView::findSpan(size_t pos) const {
+    return upper_bound(offsets.begin(), offsets.end(), pos) - offsets.begin() - 1;
+}
+
+char BufferView::operator[](size_t pos) const {
+    size_t spanIdx = findSpan(pos);
+    return spans[spanIdx].data[pos - offsets[spanIdx]];
+}
+
+string BufferView::substr(size_t pos, size_t length) const {
+    if (pos >= totalLength) return "";
+    length = min(length, totalLength - pos);
+    
+    string result;
+    result.reserve(length);
     
-    if (text.empty()) {
-        chunks.push_back("");
+    size_t spanIdx = findSpan(pos);
+    size_t offset = pos - offsets[spanIdx];
+    while (result.length() < length) {
+        size_t take = min(spans[spanIdx].length - offset, length - result.length());
+        result.append(spans[spanIdx].data + offset, take);
+        spanIdx++;
+        offset = 0;
+    }
+    
+    return result;
+}
+
+BufferView BufferView::subview(size_t pos, size_t length) const {
+    vector<TextSpan> pieces;
+    if (pos >= totalLength) return BufferView(pieces);
+    length = min(length, totalLength - pos);
+    
+    size_t spanIdx = findSpan(pos);
+    size_t offset = pos - offsets[spanIdx];
+    size_t taken = 0;
+    while (taken < length) {
+        size_t take = min(spans[spanIdx].length - offset, length - taken);
+        pieces.push_back(TextSpan(spans[spanIdx].data + offset, take));
+        taken += take;
+        spanIdx++;
+        offset = 0;
+    }
+    return BufferView(pieces);
+}
+
+BufferView::const_iterator::const_iterator(const BufferView* v, size_t position)
+    : view(v), spanIdx(0), offset(0), pos(0) {
+    seek(position);
+}
+
+void BufferView::const_iterator::seek(size_t newPos) {
+    pos = newPos;
+    
+    if (pos >= view->totalLength) {
+        spanIdx = view->spans.size();
+        offset = 0;
         return;
     }
     
-    for (size_t i = 0; i < text.length(); i += CHUNK_SIZE) {
-        chunks.push_back(text.substr(i, CHUNK_SIZE));
+    // Stay in the current span when possible, otherwise binary search
+    if (spanIdx >= view->spans.size() || pos < view->offsets[spanIdx] ||
+        pos >= view->offsets[spanIdx] + view->spans[spanIdx].length) {
+        spanIdx = view->findSpan(pos);
     }
+    offset = pos - view->offsets[spanIdx];
+}
+
+BufferView::const_iterator& BufferView::const_iterator::operator++() {
+    pos++;
+    if (++offset == view->spans[spanIdx].length) {
+        spanIdx++;
+        offset = 0;
+    }
+    return *this;
+}
+
+BufferView::const_iterator& BufferView::const_iterator::operator--() {
+    pos--;
+    if (offset == 0) {
+        spanIdx--;
+        offset = view->spans[spanIdx].length - 1;
+    } else {
+        offset--;
+    }
+    return *this;
+}
+
+// ==================== TextStorage Implementation ====================
+
+void TextStorage::applyEdits(const vector<TextEdit>& edits) {
+    // Right to left, so earlier positions stay valid
+    for (size_t i = edits.size(); i-- > 0; ) {
+        deleteText(edits[i].position, edits[i].length);
+        insert(edits[i].position, edits[i].text);
+    }
+}
+
+// ==================== ChunkedStorage Implementation ====================
+
+string& ChunkedStorage::Chunk::materialize() {
+    if (borrowed) {
+        text.assign(borrowed, borrowedLength);
+        borrowed = nullptr;
+        borrowedLength = 0;
+    }
+    return text;
+}
+
+void ChunkedStorage::Chunk::erase(size_t pos, size_t count) {
+    // Trimming either end of a borrowed slice just narrows the slice
+    if (borrowed && pos == 0) {
+        borrowed += count;
+        borrowedLength -= count;
+    } else if (borrowed && pos + count == borrowedLength) {
+        borrowedLength = pos;
+    } else {
+        materialize().erase(pos, count);
+    }
+}
+
+ChunkedStorage::ChunkedStorage()
+    : totalLength(0), lineCountsValid(true), batchMode(false) {
+    chunks.insert(0, Chunk(), 0, 0);
+}
+
+void ChunkedStorage::setText(const string& text) {
+    chunks.clear();
     totalLength = text.length();
+    lineCountsValid = false;
+    
+    vector<Chunk> source;
+    source.reserve(text.length() / CHUNK_SIZE + 1);
+    for (size_t i = 0; i < text.length(); i += CHUNK_SIZE) {
+        source.push_back(Chunk(text.substr(i, CHUNK_SIZE)));
+    }
+    
+    // Folds a short tail into its neighbour so every chunk is at least MIN_CHUNK_SIZE
+    normalizeChunks(source);
+}
+
+void ChunkedStorage::setExternalText(const char* data, size_t length) {
+    totalLength = length;
+    lineCountsValid = false;  // counted lazily so loading stays O(chunks)
+    
+    // Large borrowed slices keep the chunk table small for huge files
+    vector<Chunk> source;
+    size_t sliceSize = EXTERNAL_CHUNK_SIZE;  // a copy: min() would need the constant's address
+    for (size_t i = 0; i < length; i += sliceSize) {
+        source.push_back(Chunk(data + i, min(sliceSize, length - i)));
+    }
+    if (source.empty()) {
+        source.push_back(Chunk());
+    }
+    chunks.assign(source, weighChunk);
+}
+
+void ChunkedStorage::weighChunk(const Chunk& chunk, size_t& length, size_t& newlines) {
+    length = chunk.length();
+    newlines = chunk.newlines;
 }
 
-size_t TextBuffer::getChunkIndex(size_t pos, size_t& localPos) const {
+void ChunkedStorage::ensureLineCounts() const {
+    if (lineCountsValid) return;
+    
+    chunks.reweigh([](Chunk& chunk, size_t& length, size_t& newlines) {
+        chunk.newlines = countNewlines(chunk.data(), chunk.length());
+        weighChunk(chunk, length, newlines);
+    });
+    lineCountsValid = true;
+}
+
+void ChunkedStorage::resizeChunk(size_t chunkIdx, long long delta, long long newlineDelta) {
+    chunks[chunkIdx].newlines += newlineDelta;
+    chunks.add(chunkIdx, delta, newlineDelta);
+}
+
+size_t ChunkedStorage::getChunkIndex(size_t pos, size_t& localPos) const {
     if (pos >= totalLength) {
         localPos = chunks.back().length();
         return chunks.size() - 1;
     }
     
-    size_t accumulated = 0;
-    for (size_t i = 0; i < chunks.size(); i++) {
-        if (accumulated + chunks[i].length() > pos) {
-            localPos = pos - accumulated;
-            return i;
-        }
-        accumulated += chunks[i].length();
-    }
-    
-    localPos = 0;
-    return 0;
+    size_t before;
+    size_t chunkIdx = chunks.findByLength(pos, before);
+    localPos = pos - before;
+    return chunkIdx;
 }
 
-void TextBuffer::insert(size_t pos, const string& text) {
+void ChunkedStorage::insert(size_t pos, const string& text) {
     if (text.empty()) return;
     
     size_t localPos;
     size_t chunkIdx = getChunkIndex(pos, localPos);
     
-    chunks[chunkIdx].insert(localPos, text);
+    chunks[chunkIdx].materialize().insert(localPos, text);
+    resizeChunk(chunkIdx, text.length(), countNewlines(text.data(), text.length()));
     totalLength += text.length();
     
-    rebalance();
+    rebalanceChunk(chunkIdx);
 }
 
-void TextBuffer::deleteText(size_t pos, size_t length) {
+void ChunkedStorage::deleteText(size_t pos, size_t length) {
     if (length == 0 || pos >= totalLength) return;
     
     length = min(length, totalLength - pos);
     
-    size_t remaining = length;
     size_t localPos;
     size_t chunkIdx = getChunkIndex(pos, localPos);
     
-    while (remaining > 0 && chunkIdx < chunks.size()) {
-        size_t availableInChunk = chunks[chunkIdx].length() - localPos;
-        size_t toDelete = min(remaining, availableInChunk);
-        
-        chunks[chunkIdx].erase(localPos, toDelete);
-        remaining -= toDelete;
-        
-        if (remaining > 0) {
-            chunkIdx++;
-            localPos = 0;
-        }
+    // Trim the tail of the first chunk
+    size_t toDelete = min(length, chunks[chunkIdx].length() - localPos);
+    size_t newlines = countNewlines(chunks[chunkIdx].data() + localPos, toDelete);
+    chunks[chunkIdx].erase(localPos, toDelete);
+    resizeChunk(chunkIdx, -(long long)toDelete, -(long long)newlines);
+    size_t remaining = length - toDelete;
+    
+    // Drop the chunks that are covered completely
+    size_t lastIdx = chunkIdx + 1;
+    while (remaining > 0 && remaining >= chunks[lastIdx].length()) {
+        remaining -= chunks[lastIdx].length();
+        lastIdx++;
+    }
+    
+    // Trim the head of the last chunk
+    if (remaining > 0) {
+        newlines = countNewlines(chunks[lastIdx].data(), remaining);
+        chunks[lastIdx].erase(0, remaining);
+        resizeChunk(lastIdx, -(long long)remaining, -(long long)newlines);
     }
     
+    if (lastIdx > chunkIdx + 1) {
+        chunks.erase(chunkIdx + 1, lastIdx);
+    }
     totalLength -= length;
-    rebalance();
-}
-
-void TextBuffer::replace(size_t pos, size_t length, const string& text) {
-    deleteText(pos, length);
-    insert(pos, text);
+    
+    // Only the two chunks at the edges of the deleted range can be underfull
+    if (chunkIdx + 1 < chunks.size()) {
+        rebalanceChunk(chunkIdx + 1);
+    }
+    rebalanceChunk(min(chunkIdx, chunks.size() - 1));
 }
 
-void TextBuffer::rebalance() {
-    vector<string> newChunks;
-    string current;
+void ChunkedStorage::rebalanceChunk(size_t chunkIdx) {
+    // Inside a batch only runaway chunks are split; everything else is
+    // repaired in one pass by endBatch()
+    if (batchMode) {
+        if (chunks[chunkIdx].length() > BATCH_MAX_CHUNK_SIZE && !chunks[chunkIdx].isBorrowed()) {
+            splitChunk(chunkIdx);
+        }
+        return;
+    }
     
-    for (const auto& chunk : chunks) {
-        current += chunk;
-        while (current.length() >= CHUNK_SIZE) {
-            newChunks.push_back(current.substr(0, CHUNK_SIZE));
-            current = current.substr(CHUNK_SIZE);
+    // Borrowed slices may stay large; they are only split once edited
+    if (chunks[chunkIdx].length() > MAX_CHUNK_SIZE) {
+        if (!chunks[chunkIdx].isBorrowed()) {
+            splitChunk(chunkIdx);
         }
+        return;
     }
     
-    if (!current.empty() || newChunks.empty()) {
-        newChunks.push_back(current);
+    if (chunks[chunkIdx].length() >= MIN_CHUNK_SIZE || chunks.size() == 1) {
+        return;
     }
     
-    chunks = move(newChunks);
+    // Underfull: merge with the next chunk (or the previous one at the end)
+    size_t left = (chunkIdx + 1 < chunks.size()) ? chunkIdx : chunkIdx - 1;
+    const Chunk& right = chunks[left + 1];
+    chunks[left].materialize().append(right.data(), right.length());
+    resizeChunk(left, right.length(), right.newlines);
+    chunks.erase(left + 1, left + 2);
+    
+    if (chunks[left].length() > MAX_CHUNK_SIZE) {
+        splitChunk(left);
+    }
 }
 
-string TextBuffer::getText() const {
+void ChunkedStorage::appendSplit(string text, vector<Chunk>& out) {
+    // Split into evenly sized pieces so no piece ends up underfull
+    size_t pieces = (text.length() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    size_t baseSize = text.length() / pieces;
+    size_t extra = text.length() % pieces;
+    
+    size_t offset = 0;
+    for (size_t i = 0; i < pieces; i++) {
+        size_t partSize = baseSize + (i < extra ? 1 : 0);
+        out.push_back(Chunk(text.substr(offset, partSize)));
+        out.back().newlines = countNewlines(out.back().text.data(), partSize);
+        offset += partSize;
+    }
+}
+
+void ChunkedStorage::splitChunk(size_t chunkIdx) {
+    vector<Chunk> parts;
+    appendSplit(move(chunks[chunkIdx].text), parts);
+    
+    chunks.erase(chunkIdx, chunkIdx + 1);
+    chunks.insert(chunkIdx, parts, weighChunk);
+}
+
+string ChunkedStorage::getText() const {
     string result;
     result.reserve(totalLength);
-    for (const auto& chunk : chunks) {
-        result += chunk;
-    }
+    chunks.forEach([&result](const Chunk& chunk) {
+        result.append(chunk.data(), chunk.length());
+    });
     return result;
 }
 
-string TextBuffer::getSubstring(size_t pos, size_t length) const {
+string ChunkedStorage::getSubstring(size_t pos, size_t length) const {
     if (pos >= totalLength) return "";
     length = min(length, totalLength - pos);
     
-    return getText().substr(pos, length);
+    // Copy only the chunks that overlap the requested range
+    string result;
+    result.reserve(length);
+    
+    size_t localPos;
+    size_t chunkIdx = getChunkIndex(pos, localPos);
+    while (result.length() < length) {
+        size_t take = min(chunks[chunkIdx].length() - localPos, length - result.length());
+        result.append(chunks[chunkIdx].data() + localPos, take);
+        chunkIdx++;
+        localPos = 0;
+    }
+    
+    return result;
 }
 
-void TextBuffer::clear() {
-    chunks.clear();
-    chunks.push_back("");
-    totalLength = 0;
+void ChunkedStorage::getSpans(vector<TextSpan>& spans) const {
+    chunks.forEach([&spans](const Chunk& chunk) {
+        spans.push_back(TextSpan(chunk.data(), chunk.length()));
+    });
 }
 
-// ==================== SearchEngine Implementation ====================
-
-long long SearchEngine::power(long long base, int exp) const {
-    long long result = 1;
-    for (int i = 0; i < exp; i++) {
-        result = (result * base) % PRIME;
-    }
-    return result;
+void ChunkedStorage::endBatch() {
+    if (!batchMode) return;
+    batchMode = false;
+    
+    vector<Chunk> source;
+    chunks.moveTo(source);
+    normalizeChunks(source);
 }
 
-long long SearchEngine::calculateHash(const string& str, int length) const {
-    long long hash = 0;
-    for (int i = 0; i < length && i < str.length(); i++) {
-        hash = (hash * BASE + static_cast<unsigned char>(str[i])) % PRIME;
+void ChunkedStorage::normalizeChunks(vector<Chunk>& source) {
+    // One left-to-right pass: drop emptied chunks, fold underfull ones into
+    // their left neighbour and split whatever grew too large
+    vector<Chunk> result;
+    result.reserve(source.size());
+    for (auto& chunk : source) {
+        if (chunk.length() == 0) continue;
+        
+        bool canMerge = !result.empty() &&
+                        (chunk.length() < MIN_CHUNK_SIZE || result.back().length() < MIN_CHUNK_SIZE) &&
+                        !(result.back().isBorrowed() && result.back().length() > MAX_CHUNK_SIZE) &&
+                        !(chunk.isBorrowed() && chunk.length() > MAX_CHUNK_SIZE);
+        if (canMerge) {
+            result.back().materialize().append(chunk.data(), chunk.length());
+            result.back().newlines += chunk.newlines;
+        } else {
+            result.push_back(move(chunk));
+        }
+        
+        if (result.back().length() > MAX_CHUNK_SIZE && !result.back().isBorrowed()) {
+            string oversized = move(result.back().text);
+            result.pop_back();
+            appendSplit(move(oversized), result);
+        }
     }
-    return hash;
-}
-// char value = static_cast<unsigned char>(str[i])
-long long SearchEngine::recalculateHash(long long oldHash, char oldChar, char newChar, 
-                                       long long pow, int length) const {
-    long long newHash = (oldHash - (static_cast<unsigned char>(oldChar) * pow) % PRIME + PRIME) % PRIME;
-    newHash = (newHash * BASE + static_cast<unsigned char>(newChar)) % PRIME;
-    return newHash;
+    
+    if (result.empty()) {
+        result.push_back(Chunk());
+    }
+    chunks.assign(result, weighChunk);
 }
 
-vector<size_t> SearchEngine::search(const string& text, const string& pattern) const {
-    vector<size_t> positions;
+void ChunkedStorage::applyEdits(const vector<TextEdit>& edits) {
+    if (edits.empty()) return;
     
-    if (pattern.empty() || pattern.length() > text.length()) {
-        return positions;
-    }
+    // Untouched chunks are moved over whole; text around each edit is
+    // gathered into new chunks
+    vector<Chunk> source;
+    chunks.moveTo(source);
+    vector<Chunk> result;
+    result.reserve(source.size() + edits.size());
+    string pending;
+    size_t chunkIdx = 0;
+    size_t chunkStart = 0;  // document position of source[chunkIdx]
+    size_t cursor = 0;      // original text before this has been consumed
     
-    int patternLen = pattern.length();
-    long long patternHash = calculateHash(pattern, patternLen);
-    long long textHash = calculateHash(text, patternLen);
-    long long pow = power(BASE, patternLen - 1);
+    auto flushPending = [&]() {
+        if (pending.empty()) return;
+        appendSplit(move(pending), result);
+        pending.clear();
+    };
     
-    for (size_t i = 0; i <= text.length() - patternLen; i++) {
-        if (textHash == patternHash) {
-            // Verify match
-            if (text.substr(i, patternLen) == pattern) {
-                positions.push_back(i);
+    auto copyUntil = [&](size_t end) {
+        while (cursor < end) {
+            Chunk& chunk = source[chunkIdx];
+            size_t chunkEnd = chunkStart + chunk.length();
+            if (cursor == chunkStart && chunkEnd <= end) {
+                flushPending();
+                result.push_back(move(chunk));
+            } else {
+                size_t take = min(chunkEnd, end) - cursor;
+                pending.append(chunk.data() + (cursor - chunkStart), take);
+            }
+            cursor = min(chunkEnd, end);
+            if (cursor == chunkEnd) {
+                chunkStart = chunkEnd;
+                chunkIdx++;
             }
         }
+    };
+    
+    long long delta = 0;
+    for (const auto& edit : edits) {
+        copyUntil(edit.position);
+        pending += edit.text;
         
-        if (i < text.length() - patternLen) {
-            textHash = recalculateHash(textHash, text[i], text[i + patternLen], pow, patternLen);
+        // Skip the replaced range
+        cursor = edit.position + edit.length;
+        while (chunkIdx < source.size() && chunkStart + source[chunkIdx].length() <= cursor) {
+            chunkStart += source[chunkIdx].length();
+            chunkIdx++;
+        }
+        delta += (long long)edit.text.length() - (long long)edit.length;
+    }
+    copyUntil(totalLength);
+    flushPending();
+    
+    totalLength += delta;
+    normalizeChunks(result);
+}
+
+void ChunkedStorage::clear() {
+    chunks.clear();
+    chunks.insert(0, Chunk(), 0, 0);
+    totalLength = 0;
+    lineCountsValid = true;
+}
+
+size_t ChunkedStorage::countNewlinesBefore(size_t pos) const {
+    ensureLineCounts();
+    
+    size_t localPos;
+    size_t chunkIdx = getChunkIndex(pos, localPos);
+    return chunks.newlinesBefore(chunkIdx) + countNewlines(chunks[chunkIdx].data(), localPos);
+}
+
+size_t ChunkedStorage::findNewline(size_t n) const {
+    ensureLineCounts();
+    
+    if (n == 0 || n > chunks.totalNewlines()) {
+        return totalLength;
+    }
+    
+    // Chunk holding the n-th newline, then scan inside it
+    size_t before;
+    size_t chunkIdx = chunks.findByNewlines(n - 1, before);
+    const char* data = chunks[chunkIdx].data();
+    const char* p = data;
+    for (size_t k = n - before; ; p++) {
+        if (*p == '\n' && --k == 0) break;
+    }
+    return chunks.lengthBefore(chunkIdx) + (p - data);
+}
+
+// ==================== TextBuffer Implementation ====================
+
+unique_ptr<TextStorage> TextBuffer::createStorage(BufferBackend backend) {
+    switch (backend) {
+        case BufferBackend::PieceTable:
+            return unique_ptr<TextStorage>(new PieceTableStorage());
+        case BufferBackend::Rope:
+            return unique_ptr<TextStorage>(new RopeStorage());
+        case BufferBackend::Chunked:
+        default:
+            return unique_ptr<TextStorage>(new ChunkedStorage());
+    }
+}
+
+TextBuffer::TextBuffer(BufferBackend backend)
+    : backend(backend), storage(createStorage(backend)), version(0) {
+    touch();
+}
+
+TextBuffer::TextBuffer(const string& text, BufferBackend backend)
+    : backend(backend), storage(createStorage(backend)), version(0) {
+    storage->setText(text);
+    touch();
+}
+
+void TextBuffer::touch() {
+    // One counter for every buffer in the process
+    static atomic<uint64_t> lastVersion(0);
+    version = ++lastVersion;
+}
+
+void TextBuffer::insert(size_t pos, const string& text) {
+    storage->insert(pos, text);
+    touch();
+}
+
+void TextBuffer::deleteText(size_t pos, size_t length) {
+    storage->deleteText(pos, length);
+    touch();
+}
+
+void TextBuffer::replace(size_t pos, size_t length, const string& text) {
+    deleteText(pos, length);
+    insert(pos, text);
+}
+
+bool TextBuffer::applyEdits(const vector<TextEdit>& edits) {
+    size_t prevEnd = 0;
+    for (const auto& edit : edits) {
+        if (edit.position < prevEnd || edit.position > length() ||
+            edit.length > length() - edit.position) {
+            return false;
         }
+        prevEnd = edit.position + edit.length;
     }
     
+    storage->applyEdits(edits);
+    touch();
+    return true;
+}
+
+string TextBuffer::getText() const {
+    return storage->getText();
+}
+
+string TextBuffer::getSubstring(size_t pos, size_t length) const {
+    return storage->getSubstring(pos, length);
+}
+
+BufferView TextBuffer::getView() const {
+    vector<TextSpan> spans;
+    storage->getSpans(spans);
+    return BufferView(spans);
+}
+
+size_t TextBuffer::getLineCount() const {
+    return storage->countNewlinesBefore(storage->length()) + 1;
+}
+
+size_t TextBuffer::getLineStart(size_t line) const {
+    if (line <= 1) return 0;
+    
+    // Line n starts right after the (n-1)-th newline
+    size_t newlinePos = storage->findNewline(line - 1);
+    if (newlinePos >= storage->length()) {
+        return getLineStart(getLineCount());
+    }
+    return newlinePos + 1;
+}
+
+void TextBuffer::getLineAndColumn(size_t pos, size_t& line, size_t& col) const {
+    pos = min(pos, storage->length());
+    line = storage->countNewlinesBefore(pos) + 1;
+    col = pos - getLineStart(line) + 1;
+}
+
+void TextBuffer::clear() {
+    storage->clear();
+    mappedFile.reset();
+    touch();
+}
+
+void TextBuffer::setText(const string& text) {
+    storage->setText(text);
+    mappedFile.reset();
+    touch();
+}
+
+void TextBuffer::setText(string&& text) {
+    storage->setText(move(text));
+    mappedFile.reset();
+    touch();
+}
+
+void TextBuffer::setMappedText(shared_ptr<MappedFile> file) {
+    storage->setExternalText(file->getData(), file->getSize());
+    mappedFile = file;
+    touch();
+}
+
+// ==================== SearchEngine Implementation ====================
+
+vector<size_t> SearchEngine::search(const string& text, const string& pattern) const {
+    vector<size_t> positions;
+    findOccurrences(text.data(), text.length(), pattern, positions);
     return positions;
 }
 
+vector<size_t> SearchEngine::search(const BufferView& text, const string& pattern) const {
+    vector<size_t> positions;
+    findOccurrences(text, pattern, positions);
+    return positions;
+}
+
+void SearchEngine::keepNonOverlapping(vector<size_t>& positions, size_t patternLength) {
+    size_t kept = 0;
+    for (size_t i = 0; i < positions.size(); i++) {
+        if (kept == 0 || positions[i] >= positions[kept - 1] + patternLength) {
+            positions[kept++] = positions[i];
+        }
+    }
+    positions.resize(kept);
+}
+
 vector<size_t> SearchEngine::searchAndReplace(string& text, const string& pattern, 
                                               const string& replacement) const {
     vector<size_t> positions = search(text, pattern);
+    keepNonOverlapping(positions, pattern.length());
+    if (positions.empty()) return positions;
     
-    // Replace from end to start to maintain position validity
-    for (auto it = positions.rbegin(); it != positions.rend(); ++it) {
-        text.replace(*it, pattern.length(), replacement);
+    // Build the result in one forward pass instead of shifting the tail
+    // of the text once per match
+    string result;
+    result.reserve(text.length() + positions.size() * replacement.length());
+    size_t last = 0;
+    for (size_t pos : positions) {
+        result.append(text, last, pos - last);
+        result += replacement;
+        last = pos + pattern.length();
     }
+    result.append(text, last, string::npos);
+    text.swap(result);
     
     return positions;
 }
 
 // ==================== Command Implementations ====================
 
+// Spill records: "<type>|<pos>|" followed by length-prefixed text fields
+static void appendField(string& record, const string& text) {
+    record += to_string(text.length());
+    record += '|';
+    record += text;
+}
+
+// Decimal digits up to the next '|'; false on anything else or on overflow,
+// so a corrupt record is refused instead of throwing
+static bool readNumber(const string& record, size_t& at, size_t& value) {
+    size_t bar = record.find('|', at);
+    if (bar == string::npos || bar == at) return false;
+    
+    size_t result = 0;
+    for (size_t i = at; i < bar; i++) {
+        if (record[i] < '0' || record[i] > '9') return false;
+        size_t digit = record[i] - '0';
+        if (result > (SIZE_MAX - digit) / 10) return false;
+        result = result * 10 + digit;
+    }
+    value = result;
+    at = bar + 1;
+    return true;
+}
+
+static bool readField(const string& record, size_t& at, string& text) {
+    size_t length;
+    if (!readNumber(record, at, length) || length > record.length() - at) return false;
+    text = record.substr(at, length);
+    at += length;
+    return true;
+}
+
+shared_ptr<Command> Command::deserialize(TextBuffer* buffer, const string& data) {
+    if (data.length() < 2 || data[1] != '|') return nullptr;
+    
+    size_t at = 2;
+    size_t position;
+    string first, second;
+    
+    if (data[0] == 'A') {
+        // "A|<count>|<old><new>" then <pos>| per match
+        size_t count;
+        if (!readNumber(data, at, count) || !readField(data, at, first) ||
+            !readField(data, at, second)) {
+            return nullptr;
+        }
+        if (count > (data.length() - at) / 2) return nullptr;  // each match takes at least "0|"
+        vector<size_t> matches(count);
+        for (size_t i = 0; i < count; i++) {
+            if (!readNumber(data, at, matches[i])) return nullptr;
+        }
+        return make_shared<ReplaceAllCommand>(buffer, move(matches), first, second);
+    }
+    
+    if (data[0] == 'M') {
+        // "M|<count>|" then <pos>|<old><new> per edit, in original coordinates
+        size_t count;
+        if (!readNumber(data, at, count) || count > (data.length() - at) / 6) return nullptr;  // "0|0|0|"
+        vector<TextEdit> edits;
+        vector<string> removed;
+        edits.reserve(count);
+        removed.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            if (!readNumber(data, at, position) || !readField(data, at, first) ||
+                !readField(data, at, second)) {
+                return nullptr;
+            }
+            edits.push_back(TextEdit(position, first.length(), second));
+            removed.push_back(move(first));
+        }
+        return make_shared<MultiEditCommand>(buffer, move(edits), move(removed));
+    }
+    
+    if (data[0] == 'T') {
+        // "T|<count>|" then <pos>|<old><new> per edit
+        size_t count;
+        if (!readNumber(data, at, count) || count > (data.length() - at) / 6) return nullptr;
+        auto composite = make_shared<CompositeCommand>(buffer);
+        for (size_t i = 0; i < count; i++) {
+            if (!readNumber(data, at, position) || !readField(data, at, first) ||
+                !readField(data, at, second)) {
+                return nullptr;
+            }
+            composite->record(position, move(first), move(second));
+        }
+        return composite;
+    }
+    
+    if (!readNumber(data, at, position) || !readField(data, at, first)) return nullptr;
+    
+    switch (data[0]) {
+        case 'I':
+            return make_shared<InsertCommand>(buffer, position, first);
+        case 'D':
+            return make_shared<DeleteCommand>(buffer, position, first);
+        case 'R':
+            if (!readField(data, at, second)) return nullptr;
+            return make_shared<ReplaceCommand>(buffer, position, first, second);
+        default:
+            return nullptr;
+    }
+}
+
 InsertCommand::InsertCommand(TextBuffer* buf, size_t pos, const string& txt)
     : buffer(buf), position(pos), text(txt) {}
 
@@ -231,9 +903,32 @@ string InsertCommand::getDescription() const {
     return "Insert " + to_string(text.length()) + " chars at " + to_string(position);
 }
 
+size_t InsertCommand::memoryUsage() const {
+    return sizeof(*this) + text.capacity();
+}
+
+string InsertCommand::serialize() const {
+    string record = "I|" + to_string(position) + "|";
+    appendField(record, text);
+    return record;
+}
+
+bool InsertCommand::mergeInsert(size_t pos, const string& txt, size_t maxLength) {
+    if (pos != position + text.length() || text.length() + txt.length() > maxLength) {
+        return false;
+    }
+    
+    buffer->insert(pos, txt);
+    text += txt;
+    return true;
+}
+
 DeleteCommand::DeleteCommand(TextBuffer* buf, size_t pos, size_t len)
     : buffer(buf), position(pos), length(len) {}
 
+DeleteCommand::DeleteCommand(TextBuffer* buf, size_t pos, const string& deleted)
+    : buffer(buf), position(pos), length(deleted.length()), deletedText(deleted) {}
+
 void DeleteCommand::execute() {
     deletedText = buffer->getSubstring(position, length);
     buffer->deleteText(position, length);
@@ -247,9 +942,43 @@ string DeleteCommand::getDescription() const {
     return "Delete " + to_string(length) + " chars at " + to_string(position);
 }
 
+size_t DeleteCommand::memoryUsage() const {
+    return sizeof(*this) + deletedText.capacity();
+}
+
+string DeleteCommand::serialize() const {
+    string record = "D|" + to_string(position) + "|";
+    appendField(record, deletedText);
+    return record;
+}
+
+bool DeleteCommand::mergeDelete(size_t pos, size_t len, size_t maxLength) {
+    if (pos >= buffer->length()) return false;
+    len = min(len, buffer->length() - pos);
+    if (len == 0 || deletedText.length() + len > maxLength) return false;
+    
+    if (pos + len == position) {
+        // Backspace: the run grows to the left
+        deletedText.insert(0, buffer->getSubstring(pos, len));
+        position = pos;
+    } else if (pos == position) {
+        // Delete key: the run grows to the right
+        deletedText += buffer->getSubstring(pos, len);
+    } else {
+        return false;
+    }
+    
+    buffer->deleteText(pos, len);
+    length = deletedText.length();
+    return true;
+}
+
 ReplaceCommand::ReplaceCommand(TextBuffer* buf, size_t pos, size_t len, const string& txt)
     : buffer(buf), position(pos), length(len), newText(txt) {}
 
+ReplaceCommand::ReplaceCommand(TextBuffer* buf, size_t pos, const string& oldTxt, const string& txt)
+    : buffer(buf), position(pos), length(oldTxt.length()), newText(txt), oldText(oldTxt) {}
+
 void ReplaceCommand::execute() {
     oldText = buffer->getSubstring(position, length);
     buffer->replace(position, length, newText);
@@ -263,90 +992,540 @@ string ReplaceCommand::getDescription() const {
     return "Replace " + to_string(length) + " chars at " + to_string(position);
 }
 
+size_t ReplaceCommand::memoryUsage() const {
+    return sizeof(*this) + newText.capacity() + oldText.capacity();
+}
+
+string ReplaceCommand::serialize() const {
+    string record = "R|" + to_string(position) + "|";
+    appendField(record, oldText);
+    appendField(record, newText);
+    return record;
+}
+
+void CompositeCommand::record(size_t pos, string oldText, string newText) {
+    edits.push_back(Edit(pos, move(oldText), move(newText)));
+}
+
+void CompositeCommand::execute() {
+    buffer->beginBatch();
+    for (const auto& edit : edits) {
+        buffer->replace(edit.position, edit.oldText.length(), edit.newText);
+    }
+    buffer->endBatch();
+}
+
+void CompositeCommand::undo() {
+    buffer->beginBatch();
+    for (size_t i = edits.size(); i-- > 0; ) {
+        const Edit& edit = edits[i];
+        buffer->replace(edit.position, edit.newText.length(), edit.oldText);
+    }
+    buffer->endBatch();
+}
+
+string CompositeCommand::getDescription() const {
+    return "Transaction of " + to_string(edits.size()) + " edits";
+}
+
+size_t CompositeCommand::memoryUsage() const {
+    size_t total = sizeof(*this) + edits.capacity() * sizeof(Edit);
+    for (const auto& edit : edits) {
+        total += edit.oldText.capacity() + edit.newText.capacity();
+    }
+    return total;
+}
+
+string CompositeCommand::serialize() const {
+    string record = "T|" + to_string(edits.size()) + "|";
+    for (const auto& edit : edits) {
+        record += to_string(edit.position) + "|";
+        appendField(record, edit.oldText);
+        appendField(record, edit.newText);
+    }
+    return record;
+}
+
+MultiEditCommand::MultiEditCommand(TextBuffer* buf, vector<TextEdit> rangeEdits)
+    : buffer(buf), edits(move(rangeEdits)) {}
+
+MultiEditCommand::MultiEditCommand(TextBuffer* buf, vector<TextEdit> rangeEdits, vector<string> removed)
+    : buffer(buf), edits(move(rangeEdits)), oldTexts(move(removed)) {}
+
+void MultiEditCommand::execute() {
+    oldTexts.clear();
+    oldTexts.reserve(edits.size());
+    for (const auto& edit : edits) {
+        oldTexts.push_back(buffer->getSubstring(edit.position, edit.length));
+    }
+    buffer->applyEdits(edits);
+}
+
+void MultiEditCommand::undo() {
+    // Map each range to where it ended up and put the old text back
+    vector<TextEdit> inverse;
+    inverse.reserve(edits.size());
+    long long delta = 0;
+    for (size_t i = 0; i < edits.size(); i++) {
+        const TextEdit& edit = edits[i];
+        inverse.push_back(TextEdit(edit.position + delta, edit.text.length(), oldTexts[i]));
+        delta += (long long)edit.text.length() - (long long)edit.length;
+    }
+    buffer->applyEdits(inverse);
+}
+
+string MultiEditCommand::getDescription() const {
+    return "Edit " + to_string(edits.size()) + " ranges";
+}
+
+size_t MultiEditCommand::memoryUsage() const {
+    size_t total = sizeof(*this) + edits.capacity() * sizeof(TextEdit) +
+                   oldTexts.capacity() * sizeof(string);
+    for (size_t i = 0; i < edits.size(); i++) {
+        total += edits[i].text.capacity();
+    }
+    for (const auto& old : oldTexts) {
+        total += old.capacity();
+    }
+    return total;
+}
+
+string MultiEditCommand::serialize() const {
+    string record = "M|" + to_string(edits.size()) + "|";
+    for (size_t i = 0; i < edits.size(); i++) {
+        record += to_string(edits[i].position) + "|";
+        appendField(record, oldTexts[i]);
+        appendField(record, edits[i].text);
+    }
+    return record;
+}
+
+ReplaceAllCommand::ReplaceAllCommand(TextBuffer* buf, vector<size_t> matches,
+                                     const string& oldTxt, const string& newTxt)
+    : buffer(buf), positions(move(matches)), oldText(oldTxt), newText(newTxt) {}
+
+vector<TextEdit> ReplaceAllCommand::buildEdits(bool inverse) const {
+    vector<TextEdit> edits;
+    edits.reserve(positions.size());
+    long long delta = (long long)newText.length() - (long long)oldText.length();
+    for (size_t i = 0; i < positions.size(); i++) {
+        if (inverse) {
+            edits.push_back(TextEdit(positions[i] + delta * (long long)i, newText.length(), oldText));
+        } else {
+            edits.push_back(TextEdit(positions[i], oldText.length(), newText));
+        }
+    }
+    return edits;
+}
+
+void ReplaceAllCommand::execute() {
+    buffer->applyEdits(buildEdits(false));
+}
+
+void ReplaceAllCommand::undo() {
+    buffer->applyEdits(buildEdits(true));
+}
+
+string ReplaceAllCommand::getDescription() const {
+    return "Replace " + to_string(positions.size()) + " matches of '" + oldText + "'";
+}
+
+size_t ReplaceAllCommand::memoryUsage() const {
+    return sizeof(*this) + positions.capacity() * sizeof(size_t) +
+           oldText.capacity() + newText.capacity();
+}
+
+string ReplaceAllCommand::serialize() const {
+    string record = "A|" + to_string(positions.size()) + "|";
+    appendField(record, oldText);
+    appendField(record, newText);
+    for (size_t pos : positions) {
+        record += to_string(pos) + "|";
+    }
+    return record;
+}
+
+// ==================== UndoTree Implementation ====================
+
+UndoTree::UndoTree() : current(0) {
+    nodes.push_back(Node(nullptr, NONE, 0));
+}
+
+size_t UndoTree::add(shared_ptr<Command> cmd) {
+    size_t id = nodes.size();
+    nodes.push_back(Node(move(cmd), current, nodes[current].depth + 1));
+    nodes[current].children.push_back(id);
+    nodes[current].redoChild = id;
+    current = id;
+    return id;
+}
+
+void UndoTree::findPath(size_t target, vector<size_t>& undoPath, vector<size_t>& redoPath) const {
+    undoPath.clear();
+    redoPath.clear();
+    
+    size_t from = current;
+    size_t to = target;
+    while (nodes[from].depth > nodes[to].depth) {
+        undoPath.push_back(from);
+        from = nodes[from].parent;
+    }
+    while (nodes[to].depth > nodes[from].depth) {
+        redoPath.push_back(to);
+        to = nodes[to].parent;
+    }
+    while (from != to) {
+        undoPath.push_back(from);
+        redoPath.push_back(to);
+        from = nodes[from].parent;
+        to = nodes[to].parent;
+    }
+    
+    reverse(redoPath.begin(), redoPath.end());
+}
+
+size_t UndoTree::findByTime(chrono::system_clock::time_point when) const {
+    // Nodes are appended in creation order, so their times are sorted
+    size_t lo = 1, hi = nodes.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (nodes[mid].created <= when) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo - 1;
+}
+
+void UndoTree::clear() {
+    nodes.clear();
+    nodes.push_back(Node(nullptr, NONE, 0));
+    current = 0;
+}
+
 // ==================== TextEditor Implementation ====================
 
-TextEditor::TextEditor() : modified(false) {}
+TextEditor::TextEditor(BufferBackend backend)
+    : buffer(backend), modified(false),
+      coalesceWindowMs(0), coalesceMaxChars(0), coalesceOpen(false),
+      undoMemoryBudget(0), undoMemory(0), spillWatermark(0), transactionDepth(0) {}
+
+void TextEditor::pushUndo(shared_ptr<Command> cmd) {
+    spillWatermark = min(spillWatermark, history.getCurrent());  // it may be spilled from now on
+    undoMemory += sizeof(UndoTree::Node) + cmd->memoryUsage();
+    history.add(move(cmd));
+    enforceUndoBudget();
+}
+
+void TextEditor::setUndoMemoryBudget(size_t bytes) {
+    undoMemoryBudget = bytes;
+    enforceUndoBudget();
+}
+
+size_t TextEditor::getUndoSpillSize() const {
+    return spillFile ? spillFile->getSize() : 0;
+}
+
+void TextEditor::enforceUndoBudget() {
+    if (undoMemoryBudget == 0) return;
+    
+    // Oldest first; the current state's command stays resident so
+    // coalescing and the next undo do not touch the disk
+    spillWatermark = max(spillWatermark, (size_t)1);  // the root has no command
+    for (size_t i = spillWatermark; i < history.size() && undoMemory > undoMemoryBudget; i++) {
+        if (i == history.getCurrent()) continue;
+        
+        shared_ptr<Command>& cmd = history.getNode(i).command;
+        size_t before = cmd->memoryUsage();
+        
+        bool spilled = dynamic_cast<SpilledCommand*>(cmd.get()) != nullptr;
+        if (!spilled && before > sizeof(SpilledCommand)) {
+            string record = cmd->serialize();
+            if (record.empty()) continue;
+            
+            if (!spillFile) {
+                spillFile = make_shared<UndoSpillFile>();
+            }
+            size_t offset;
+            if (!spillFile->append(record, offset)) return;  // keep it in memory
+            cmd = make_shared<SpilledCommand>(&buffer, spillFile, offset, record.length());
+        }
+        
+        undoMemory = undoMemory - before + cmd->memoryUsage();
+        if (spillWatermark == i) {
+            spillWatermark = i + 1;  // everything below is on disk
+        }
+    }
+}
+
+void TextEditor::setCoalescing(unsigned int windowMs, size_t maxChars) {
+    coalesceWindowMs = windowMs;
+    coalesceMaxChars = maxChars;
+    coalesceOpen = false;
+}
 
-void TextEditor::clearRedoStack() {
-    while (!redoStack.empty()) {
-        redoStack.pop();
+bool TextEditor::canCoalesce() {
+    // Only a leaf may grow: other branches replay on top of its command
+    const UndoTree::Node& node = history.getNode(history.getCurrent());
+    auto now = chrono::steady_clock::now();
+    bool inWindow = coalesceOpen && coalesceWindowMs > 0 && node.command && node.children.empty() &&
+                    now - lastEditTime <= chrono::milliseconds(coalesceWindowMs);
+    lastEditTime = now;
+    return inWindow;
+}
+
+void TextEditor::beginTransaction() {
+    if (transactionDepth++ == 0) {
+        transaction = make_shared<CompositeCommand>(&buffer);
+        buffer.beginBatch();
+        coalesceOpen = false;
     }
 }
 
+bool TextEditor::commit() {
+    if (transactionDepth == 0) return false;
+    if (--transactionDepth > 0) return true;
+    
+    buffer.endBatch();
+    if (!transaction->empty()) {
+        pushUndo(move(transaction));
+    }
+    transaction.reset();
+    return true;
+}
+
+bool TextEditor::rollback() {
+    if (transactionDepth == 0) return false;
+    
+    buffer.endBatch();
+    transaction->undo();
+    transaction.reset();
+    transactionDepth = 0;
+    return true;
+}
+
 void TextEditor::insert(size_t pos, const string& text) {
+    modified = true;
+    if (transaction) {
+        pos = min(pos, buffer.length());
+        buffer.insert(pos, text);
+        transaction->record(pos, "", text);
+        return;
+    }
+    if (canCoalesce()) {
+        Command* top = history.getNode(history.getCurrent()).command.get();
+        size_t before = top->memoryUsage();
+        if (top->mergeInsert(pos, text, coalesceMaxChars)) {
+            undoMemory = undoMemory - before + top->memoryUsage();
+            enforceUndoBudget();
+            return;
+        }
+    }
+    
     auto cmd = make_shared<InsertCommand>(&buffer, pos, text);
     cmd->execute();
-    undoStack.push(cmd);
-    clearRedoStack();
-    modified = true;
+    pushUndo(move(cmd));
+    coalesceOpen = true;
 }
 
 void TextEditor::deleteText(size_t pos, size_t length) {
+    modified = true;
+    if (transaction) {
+        if (pos >= buffer.length()) return;
+        string removed = buffer.getSubstring(pos, length);
+        buffer.deleteText(pos, length);
+        transaction->record(pos, move(removed), "");
+        return;
+    }
+    if (canCoalesce()) {
+        Command* top = history.getNode(history.getCurrent()).command.get();
+        size_t before = top->memoryUsage();
+        if (top->mergeDelete(pos, length, coalesceMaxChars)) {
+            undoMemory = undoMemory - before + top->memoryUsage();
+            enforceUndoBudget();
+            return;
+        }
+    }
+    
     auto cmd = make_shared<DeleteCommand>(&buffer, pos, length);
     cmd->execute();
-    undoStack.push(cmd);
-    clearRedoStack();
-    modified = true;
+    pushUndo(move(cmd));
+    coalesceOpen = true;
 }
 
 void TextEditor::replace(size_t pos, size_t length, const string& text) {
+    if (transaction) {
+        pos = min(pos, buffer.length());
+        string removed = buffer.getSubstring(pos, length);
+        buffer.replace(pos, length, text);
+        transaction->record(pos, move(removed), text);
+        modified = true;
+        return;
+    }
+    
     auto cmd = make_shared<ReplaceCommand>(&buffer, pos, length, text);
     cmd->execute();
-    undoStack.push(cmd);
-    clearRedoStack();
+    pushUndo(move(cmd));
+    coalesceOpen = false;
     modified = true;
 }
 
-bool TextEditor::undo() {
-    if (undoStack.empty()) return false;
+bool TextEditor::applyEdits(const vector<TextEdit>& edits) {
+    if (edits.empty()) return true;
+    
+    vector<string> removed;
+    removed.reserve(edits.size());
+    for (const auto& edit : edits) {
+        removed.push_back(buffer.getSubstring(edit.position, edit.length));
+    }
+    if (!buffer.applyEdits(edits)) return false;
+    modified = true;
+    
+    if (transaction) {
+        // The transaction replays edits in order, so shift each one past
+        // the ranges before it
+        long long delta = 0;
+        for (size_t i = 0; i < edits.size(); i++) {
+            transaction->record(edits[i].position + delta, move(removed[i]), edits[i].text);
+            delta += (long long)edits[i].text.length() - (long long)edits[i].length;
+        }
+        return true;
+    }
     
-    auto cmd = undoStack.top();
-    undoStack.pop();
+    pushUndo(make_shared<MultiEditCommand>(&buffer, edits, move(removed)));
+    coalesceOpen = false;
+    return true;
+}
+
+bool TextEditor::stepUndo() {
+    size_t id = history.getCurrent();
+    Command* cmd = history.getNode(id).command.get();
+    
+    // A spilled command is read back from disk here and dropped again
+    // once applied, so it never counts against the budget
+    size_t before = cmd->memoryUsage();
+    if (!cmd->prepare()) return false;
     cmd->undo();
-    redoStack.push(cmd);
+    undoMemory = undoMemory - before + cmd->memoryUsage();
+    
+    history.setCurrent(history.getNode(id).parent);
+    return true;
+}
+
+bool TextEditor::stepRedo(size_t child) {
+    Command* cmd = history.getNode(child).command.get();
+    
+    size_t before = cmd->memoryUsage();
+    if (!cmd->prepare()) return false;
+    cmd->execute();
+    undoMemory = undoMemory - before + cmd->memoryUsage();
+    
+    history.getNode(history.getCurrent()).redoChild = child;
+    history.setCurrent(child);
+    return true;
+}
+
+bool TextEditor::undo() {
+    if (!canUndo() || transaction) return false;
+    
+    if (!stepUndo()) return false;
+    enforceUndoBudget();
+    coalesceOpen = false;
     modified = true;
     return true;
 }
 
 bool TextEditor::redo() {
-    if (redoStack.empty()) return false;
+    if (!canRedo() || transaction) return false;
     
-    auto cmd = redoStack.top();
-    redoStack.pop();
-    cmd->execute();
-    undoStack.push(cmd);
+    if (!stepRedo(history.getNode(history.getCurrent()).redoChild)) return false;
+    enforceUndoBudget();
+    coalesceOpen = false;
     modified = true;
     return true;
 }
 
+bool TextEditor::jumpTo(size_t state) {
+    vector<size_t> undoPath, redoPath;
+    history.findPath(state, undoPath, redoPath);
+    
+    bool reached = true;
+    for (size_t i = 0; i < undoPath.size() && reached; i++) {
+        reached = stepUndo();
+    }
+    for (size_t i = 0; i < redoPath.size() && reached; i++) {
+        reached = stepRedo(redoPath[i]);
+    }
+    
+    enforceUndoBudget();
+    coalesceOpen = false;
+    modified = true;
+    return reached;
+}
+
+bool TextEditor::jumpToState(size_t state) {
+    if (state >= history.size() || transaction) return false;
+    if (state != history.getCurrent()) {
+        return jumpTo(state);
+    }
+    return true;
+}
+
+bool TextEditor::jumpToTime(chrono::system_clock::time_point when) {
+    return jumpToState(history.findByTime(when));
+}
+
 vector<size_t> TextEditor::search(const string& pattern) const {
-    return searchEngine.search(buffer.getText(), pattern);
+    return searchEngine.search(buffer.getView(), pattern);
 }
 
 int TextEditor::searchAndReplace(const string& pattern, const string& replacement) {
-    string text = buffer.getText();
-    auto positions = searchEngine.searchAndReplace(text, pattern, replacement);
+    // Search the chunks in place and patch only the matched ranges
+    vector<size_t> positions = searchEngine.search(buffer.getView(), pattern);
+    SearchEngine::keepNonOverlapping(positions, pattern.length());
+    if (positions.empty()) return 0;
     
-    if (!positions.empty()) {
-        buffer.setText(text);
-        modified = true;
+    int count = positions.size();
+    if (transaction) {
+        vector<TextEdit> edits;
+        edits.reserve(positions.size());
+        for (size_t pos : positions) {
+            edits.push_back(TextEdit(pos, pattern.length(), replacement));
+        }
+        applyEdits(edits);
+        return count;
     }
     
-    return positions.size();
+    auto cmd = make_shared<ReplaceAllCommand>(&buffer, move(positions), pattern, replacement);
+    cmd->execute();
+    pushUndo(move(cmd));
+    coalesceOpen = false;
+    modified = true;
+    return count;
 }
 
 bool TextEditor::loadFromFile(const string& filepath) {
     // Automatically add data/ prefix
     string fullPath = addDataFolder(filepath);
     
-    ifstream file(fullPath);
-    if (!file.is_open()) {
-        return false;
+    // Map the file and let the buffer reference its pages directly;
+    // fall back to reading it when mapping is not available
+    auto mapped = make_shared<MappedFile>();
+    if (mapped->open(fullPath)) {
+        resetHistory();
+        buffer.setMappedText(mapped);
+    } else {
+        ifstream file(fullPath);
+        if (!file.is_open()) {
+            return false;
+        }
+        
+        stringstream ss;
+        ss << file.rdbuf();
+        resetHistory();
+        buffer.setText(ss.str());
     }
-    
-    stringstream ss;
-    ss << file.rdbuf();
-    buffer.setText(ss.str());
     filename = fullPath;  // Store full path with data/
     modified = false;
     
@@ -360,18 +1539,34 @@ bool TextEditor::saveToFile(const string& filepath) {
     string path = filepath.empty() ? filename : addDataFolder(filepath);
     if (path.empty()) return false;
     
-    ofstream file(path);
-    if (!file.is_open()) return false;
+    // The rename leaves a mapped source file's old pages intact, so the
+    // buffer can keep referencing them after saving over it
+    if (!writeFileAtomically(path, buffer.getView())) return false;
+    
+    if (fileIndex) {
+        fileIndex->updateFile(path, buffer.getView());
+    }
     
-    file << buffer.getText();
     filename = path;
     modified = false;
     return true;
 }
 
 void TextEditor::clear() {
+    resetHistory();
     buffer.clear();
-    while (!undoStack.empty()) undoStack.pop();
-    while (!redoStack.empty()) redoStack.pop();
     modified = false;
+}
+
+void TextEditor::resetHistory() {
+    if (transaction) {
+        buffer.endBatch();
+    }
+    history.clear();
+    transaction.reset();
+    transactionDepth = 0;
+    undoMemory = 0;
+    spillWatermark = 0;
+    spillFile.reset();
+    coalesceOpen = false;
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// ==================== MappedFile Implementation ====================
+
+MappedFile::MappedFile() : data(nullptr), size(0) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const string& filepath) {
+    close();
+    
+#ifdef _WIN32
+    (void)filepath;
+    return false;
+#else
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    
+    // The mapping stays valid after the descriptor is closed
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+    
+    data = static_cast<const char*>(mapped);
+    size = info.st_size;
+    path = filepath;
+    return true;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (data) {
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+    path.clear();
+}
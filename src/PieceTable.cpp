@@ -0,0 +1,265 @@
+#include "PieceTable.h"
+#include <algorithm>
+
+using namespace std;
+
+// ==================== PieceTableStorage Implementation ====================
+
+PieceTableStorage::PieceTableStorage()
+    : originalData(nullptr), originalLength(0), totalLength(0), lineIndexReady(false) {}
+
+void PieceTableStorage::setText(const string& text) {
+    setText(string(text));
+}
+
+void PieceTableStorage::setText(string&& text) {
+    ownedOriginal = move(text);
+    setExternalText(ownedOriginal.data(), ownedOriginal.length());
+}
+
+void PieceTableStorage::setExternalText(const char* data, size_t length) {
+    if (data != ownedOriginal.data()) {
+        ownedOriginal.clear();
+    }
+    originalData = data;
+    originalLength = length;
+    added.clear();
+    pieces.clear();
+    totalLength = length;
+    originalNewlines.clear();
+    addedNewlines.clear();
+    lineIndexReady = false;
+    
+    if (length > 0) {
+        pieces.insert(0, Piece(false, 0, length), length, 0);  // newlines weighed by ensureLineIndex()
+    }
+}
+
+void PieceTableStorage::clear() {
+    ownedOriginal.clear();
+    originalData = nullptr;
+    originalLength = 0;
+    added.clear();
+    pieces.clear();
+    totalLength = 0;
+    originalNewlines.clear();
+    addedNewlines.clear();
+    lineIndexReady = false;
+}
+
+const char* PieceTableStorage::pieceData(const Piece& piece) const {
+    return (piece.inAdded ? added.data() : originalData) + piece.start;
+}
+
+size_t PieceTableStorage::pieceNewlines(const Piece& piece, size_t length) const {
+    const vector<size_t>& offsets = piece.inAdded ? addedNewlines : originalNewlines;
+    return lower_bound(offsets.begin(), offsets.end(), piece.start + length) -
+           lower_bound(offsets.begin(), offsets.end(), piece.start);
+}
+
+void PieceTableStorage::weighPiece(const Piece& piece, size_t& length, size_t& newlines) const {
+    length = piece.length;
+    newlines = pieceNewlines(piece, piece.length);
+}
+
+void PieceTableStorage::appendAdded(const string& text) {
+    for (size_t i = 0; i < text.length(); i++) {
+        if (text[i] == '\n') {
+            addedNewlines.push_back(added.length() + i);
+        }
+    }
+    added += text;
+}
+
+void PieceTableStorage::ensureLineIndex() const {
+    if (lineIndexReady) return;
+    
+    // One pass over the original text; every later query is O(log n)
+    for (size_t i = 0; i < originalLength; i++) {
+        if (originalData[i] == '\n') {
+            originalNewlines.push_back(i);
+        }
+    }
+    lineIndexReady = true;
+    
+    // Until now original pieces were weighed with no newlines
+    pieces.reweigh([this](Piece& piece, size_t& length, size_t& newlines) {
+        weighPiece(piece, length, newlines);
+    });
+}
+
+size_t PieceTableStorage::getPieceIndex(size_t pos, size_t& localPos) const {
+    size_t before;
+    size_t pieceIdx = pieces.findByLength(pos, before);
+    localPos = pos - before;
+    return pieceIdx;
+}
+
+size_t PieceTableStorage::splitAt(size_t pos) {
+    if (pos >= totalLength) return pieces.size();
+    
+    size_t localPos;
+    size_t pieceIdx = getPieceIndex(pos, localPos);
+    if (localPos == 0) return pieceIdx;
+    
+    Piece right = pieces[pieceIdx];
+    right.start += localPos;
+    right.length -= localPos;
+    size_t rightNewlines = pieceNewlines(right, right.length);
+    pieces[pieceIdx].length = localPos;
+    pieces.add(pieceIdx, -(long long)right.length, -(long long)rightNewlines);
+    pieces.insert(pieceIdx + 1, right, right.length, rightNewlines);
+    
+    return pieceIdx + 1;
+}
+
+void PieceTableStorage::insert(size_t pos, const string& text) {
+    if (text.empty()) return;
+    pos = min(pos, totalLength);
+    
+    // Typing right after the newest added text just extends its piece
+    if (pos > 0) {
+        size_t localPos;
+        size_t prevIdx = getPieceIndex(pos - 1, localPos);
+        Piece& prev = pieces[prevIdx];
+        if (prev.inAdded && localPos + 1 == prev.length &&
+            prev.start + prev.length == added.length()) {
+            appendAdded(text);
+            prev.length += text.length();
+            pieces.add(prevIdx, text.length(), countNewlines(text.data(), text.length()));
+            totalLength += text.length();
+            return;
+        }
+    }
+    
+    size_t insertIdx = splitAt(pos);
+    pieces.insert(insertIdx, Piece(true, added.length(), text.length()),
+                  text.length(), countNewlines(text.data(), text.length()));
+    appendAdded(text);
+    totalLength += text.length();
+}
+
+void PieceTableStorage::deleteText(size_t pos, size_t length) {
+    if (length == 0 || pos >= totalLength) return;
+    
+    length = min(length, totalLength - pos);
+    
+    // Cut the pieces at both ends of the range, then drop everything between
+    size_t firstIdx = splitAt(pos);
+    size_t lastIdx = splitAt(pos + length);
+    pieces.erase(firstIdx, lastIdx);
+    
+    totalLength -= length;
+}
+
+void PieceTableStorage::applyEdits(const vector<TextEdit>& edits) {
+    if (edits.empty()) return;
+    
+    // Rebuild the piece list in one pass: slices between edits are kept,
+    // each replacement becomes one piece of the add buffer
+    vector<Piece> source;
+    pieces.moveTo(source);
+    vector<Piece> result;
+    result.reserve(source.size() + edits.size() * 2);
+    size_t pieceIdx = 0;
+    size_t pieceStart = 0;  // document position of source[pieceIdx]
+    size_t cursor = 0;
+    size_t newLength = totalLength;
+    
+    auto advanceTo = [&](size_t pos, bool keep) {
+        while (cursor < pos) {
+            const Piece& piece = source[pieceIdx];
+            size_t pieceEnd = pieceStart + piece.length;
+            size_t end = min(pieceEnd, pos);
+            if (keep) {
+                result.push_back(Piece(piece.inAdded, piece.start + (cursor - pieceStart), end - cursor));
+            }
+            cursor = end;
+            if (cursor == pieceEnd) {
+                pieceStart = pieceEnd;
+                pieceIdx++;
+            }
+        }
+    };
+    
+    for (const auto& edit : edits) {
+        advanceTo(edit.position, true);
+        if (!edit.text.empty()) {
+            result.push_back(Piece(true, added.length(), edit.text.length()));
+            appendAdded(edit.text);
+        }
+        advanceTo(edit.position + edit.length, false);
+        newLength += edit.text.length() - edit.length;
+    }
+    advanceTo(totalLength, true);
+    
+    pieces.assign(result, [this](const Piece& piece, size_t& length, size_t& newlines) {
+        weighPiece(piece, length, newlines);
+    });
+    totalLength = newLength;
+}
+
+string PieceTableStorage::getText() const {
+    string result;
+    result.reserve(totalLength);
+    pieces.forEach([this, &result](const Piece& piece) {
+        result.append(pieceData(piece), piece.length);
+    });
+    return result;
+}
+
+void PieceTableStorage::getSpans(vector<TextSpan>& spans) const {
+    pieces.forEach([this, &spans](const Piece& piece) {
+        spans.push_back(TextSpan(pieceData(piece), piece.length));
+    });
+}
+
+string PieceTableStorage::getSubstring(size_t pos, size_t length) const {
+    if (pos >= totalLength) return "";
+    length = min(length, totalLength - pos);
+    
+    string result;
+    result.reserve(length);
+    
+    size_t localPos;
+    size_t pieceIdx = getPieceIndex(pos, localPos);
+    while (result.length() < length) {
+        const Piece& piece = pieces[pieceIdx];
+        size_t take = min(piece.length - localPos, length - result.length());
+        result.append(pieceData(piece) + localPos, take);
+        pieceIdx++;
+        localPos = 0;
+    }
+    
+    return result;
+}
+
+size_t PieceTableStorage::countNewlinesBefore(size_t pos) const {
+    ensureLineIndex();
+    
+    if (pos >= totalLength) {
+        return pieces.totalNewlines();
+    }
+    
+    size_t localPos;
+    size_t pieceIdx = getPieceIndex(pos, localPos);
+    return pieces.newlinesBefore(pieceIdx) + pieceNewlines(pieces[pieceIdx], localPos);
+}
+
+size_t PieceTableStorage::findNewline(size_t n) const {
+    ensureLineIndex();
+    
+    if (n == 0 || n > pieces.totalNewlines()) {
+        return totalLength;
+    }
+    
+    // Piece holding the n-th newline, then index into its buffer's offsets
+    size_t before;
+    size_t pieceIdx = pieces.findByNewlines(n - 1, before);
+    const Piece& piece = pieces[pieceIdx];
+    const vector<size_t>& offsets = piece.inAdded ? addedNewlines : originalNewlines;
+    size_t first = lower_bound(offsets.begin(), offsets.end(), piece.start) - offsets.begin();
+    size_t offset = offsets[first + (n - before) - 1];
+    
+    return pieces.lengthBefore(pieceIdx) + (offset - piece.start);
+}
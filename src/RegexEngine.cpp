@@ -0,0 +1,701 @@
+#include "RegexEngine.h"
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+
+static const size_t NO_THREAD = (size_t)-1;
+
+// ==================== Parse Tree ====================
+
+struct Regex::Node {
+    enum Type { Chars, Concat, Alternate, Repeat, LineStart, LineEnd };
+    
+    Type type;
+    bitset<256> chars;                  // Chars
+    vector<unique_ptr<Node>> children;  // Concat, Alternate, Repeat (one child)
+    int minCount;
+    int maxCount;                       // -1 = unbounded
+    
+    explicit Node(Type t) : type(t), minCount(0), maxCount(0) {}
+};
+
+// Recursive descent over the pattern; every method returns nullptr (and
+// sets error) when the pattern is malformed
+class Regex::Parser {
+private:
+    static const int MAX_DEPTH = 200;
+    static const int MAX_REPEAT = 1000;
+    
+    const string& pattern;
+    bool caseSensitive;
+    size_t at;
+    string error;
+    
+    bool atEnd() const { return at >= pattern.length(); }
+    
+    unique_ptr<Node> fail(const string& message) {
+        if (error.empty()) {
+            error = message + " at offset " + to_string(at);
+        }
+        return nullptr;
+    }
+    
+    void foldCase(bitset<256>& chars) const {
+        if (caseSensitive) return;
+        for (int c = 0; c < 256; c++) {
+            if (chars.test(c)) {
+                chars.set((unsigned char)tolower(c));
+                chars.set((unsigned char)toupper(c));
+            }
+        }
+    }
+    
+    unique_ptr<Node> makeChars(const bitset<256>& chars) const {
+        unique_ptr<Node> node(new Node(Node::Chars));
+        node->chars = chars;
+        return node;
+    }
+    
+    // Escape after the backslash, added to chars; false on an unknown one
+    bool parseEscape(bitset<256>& chars) {
+        if (atEnd()) {
+            fail("trailing backslash");
+            return false;
+        }
+        
+        char e = pattern[at++];
+        bitset<256> set;
+        bool negate = false;
+        switch (e) {
+            case 'D': negate = true;  // fall through
+            case 'd':
+                for (int c = '0'; c <= '9'; c++) set.set(c);
+                break;
+            case 'W': negate = true;  // fall through
+            case 'w':
+                for (int c = 0; c < 256; c++) {
+                    if (isalnum(c) || c == '_') set.set(c);
+                }
+                break;
+            case 'S': negate = true;  // fall through
+            case 's':
+                for (char c : string(" \t\n\r\f\v")) set.set((unsigned char)c);
+                break;
+            case 'n': set.set('\n'); break;
+            case 't': set.set('\t'); break;
+            case 'r': set.set('\r'); break;
+            case 'f': set.set('\f'); break;
+            case 'v': set.set('\v'); break;
+            default:
+                if (isalnum((unsigned char)e)) {
+                    at--;
+                    fail(string("unsupported escape \\") + e);
+                    return false;
+                }
+                set.set((unsigned char)e);
+                break;
+        }
+        
+        chars |= negate ? ~set : set;
+        return true;
+    }
+    
+    // One class member: a byte, or a set from an escape like \d
+    bool parseClassItem(bitset<256>& chars, int& single) {
+        single = -1;
+        if (pattern[at] == '\\') {
+            at++;
+            bitset<256> escaped;
+            if (!parseEscape(escaped)) return false;
+            if (escaped.count() == 1) {
+                for (int c = 0; c < 256; c++) {
+                    if (escaped.test(c)) single = c;
+                }
+            }
+            chars |= escaped;
+        } else {
+            single = (unsigned char)pattern[at++];
+            chars.set(single);
+        }
+        return true;
+    }
+    
+    unique_ptr<Node> parseClass() {
+        at++;  // '['
+        bool negate = !atEnd() && pattern[at] == '^';
+        if (negate) at++;
+        
+        bitset<256> chars;
+        bool first = true;
+        while (true) {
+            if (atEnd()) return fail("missing ]");
+            if (pattern[at] == ']' && !first) {
+                at++;
+                break;
+            }
+            first = false;
+            
+            bitset<256> item;
+            int low;
+            if (!parseClassItem(item, low)) return nullptr;
+            
+            // Range a-z, unless the '-' is the last character of the class
+            if (at + 1 < pattern.length() && pattern[at] == '-' && pattern[at + 1] != ']') {
+                at++;
+                bitset<256> ignored;
+                int high;
+                if (!parseClassItem(ignored, high)) return nullptr;
+                if (low < 0 || high < 0 || high < low) return fail("bad character range");
+                for (int c = low; c <= high; c++) item.set(c);
+            }
+            chars |= item;
+        }
+        
+        foldCase(chars);
+        if (negate) chars.flip();
+        return makeChars(chars);
+    }
+    
+    // {m}, {m,} or {m,n}; false without an error when it is a literal '{'
+    bool parseCount(int& minCount, int& maxCount) {
+        size_t p = at + 1;
+        auto readNumber = [&](int& value) {
+            size_t digits = p;
+            value = 0;
+            while (p < pattern.length() && isdigit((unsigned char)pattern[p])) {
+                if (value <= MAX_REPEAT) {
+                    value = value * 10 + (pattern[p] - '0');
+                }
+                p++;
+            }
+            return p > digits;
+        };
+        
+        if (!readNumber(minCount)) return false;
+        maxCount = minCount;
+        if (p < pattern.length() && pattern[p] == ',') {
+            p++;
+            if (!readNumber(maxCount)) maxCount = -1;
+        }
+        if (p >= pattern.length() || pattern[p] != '}') return false;
+        
+        at = p + 1;
+        if (minCount > MAX_REPEAT || maxCount > MAX_REPEAT) {
+            fail("repeat count too large");
+            return false;
+        }
+        if (maxCount >= 0 && maxCount < minCount) {
+            fail("bad repeat range");
+            return false;
+        }
+        return true;
+    }
+    
+    unique_ptr<Node> parseAtom(int depth) {
+        if (depth > MAX_DEPTH) return fail("pattern nested too deeply");
+        
+        char c = pattern[at];
+        bitset<256> chars;
+        switch (c) {
+            case '(': {
+                at++;
+                if (pattern.compare(at, 2, "?:") == 0) {
+                    at += 2;
+                } else if (!atEnd() && pattern[at] == '?') {
+                    return fail("unsupported group");
+                }
+                unique_ptr<Node> inner = parseAlternation(depth + 1);
+                if (!inner) return nullptr;
+                if (atEnd() || pattern[at] != ')') return fail("missing )");
+                at++;
+                return inner;
+            }
+            case '*':
+            case '+':
+            case '?':
+                return fail("nothing to repeat");
+            case '[':
+                return parseClass();
+            case '.':
+                at++;
+                chars.set();
+                chars.reset('\n');
+                return makeChars(chars);
+            case '^':
+                at++;
+                return unique_ptr<Node>(new Node(Node::LineStart));
+            case '$':
+                at++;
+                return unique_ptr<Node>(new Node(Node::LineEnd));
+            case '\\':
+                at++;
+                if (!parseEscape(chars)) return nullptr;
+                foldCase(chars);
+                return makeChars(chars);
+            default:
+                at++;
+                chars.set((unsigned char)c);
+                foldCase(chars);
+                return makeChars(chars);
+        }
+    }
+    
+    unique_ptr<Node> parseRepeat(int depth) {
+        unique_ptr<Node> atom = parseAtom(depth);
+        if (!atom) return nullptr;
+        
+        while (!atEnd()) {
+            int minCount, maxCount;
+            char c = pattern[at];
+            if (c == '*') {
+                minCount = 0;
+                maxCount = -1;
+                at++;
+            } else if (c == '+') {
+                minCount = 1;
+                maxCount = -1;
+                at++;
+            } else if (c == '?') {
+                minCount = 0;
+                maxCount = 1;
+                at++;
+            } else if (c == '{' && parseCount(minCount, maxCount)) {
+                // at is past the '}'
+            } else if (!error.empty()) {
+                return nullptr;
+            } else {
+                break;
+            }
+            
+            // Matches are leftmost-longest, so a lazy form would be ignored
+            if (!atEnd() && pattern[at] == '?') return fail("lazy quantifiers are not supported");
+            
+            unique_ptr<Node> repeat(new Node(Node::Repeat));
+            repeat->minCount = minCount;
+            repeat->maxCount = maxCount;
+            repeat->children.push_back(move(atom));
+            atom = move(repeat);
+        }
+        return atom;
+    }
+    
+    unique_ptr<Node> parseConcat(int depth) {
+        unique_ptr<Node> concat(new Node(Node::Concat));
+        while (!atEnd() && pattern[at] != '|' && pattern[at] != ')') {
+            unique_ptr<Node> item = parseRepeat(depth);
+            if (!item) return nullptr;
+            concat->children.push_back(move(item));
+        }
+        return concat;
+    }
+    
+    unique_ptr<Node> parseAlternation(int depth) {
+        unique_ptr<Node> first = parseConcat(depth);
+        if (!first || atEnd() || pattern[at] != '|') return first;
+        
+        unique_ptr<Node> alternate(new Node(Node::Alternate));
+        alternate->children.push_back(move(first));
+        while (!atEnd() && pattern[at] == '|') {
+            at++;
+            unique_ptr<Node> branch = parseConcat(depth);
+            if (!branch) return nullptr;
+            alternate->children.push_back(move(branch));
+        }
+        return alternate;
+    }
+
+public:
+    Parser(const string& p, bool cs) : pattern(p), caseSensitive(cs), at(0) {}
+    
+    unique_ptr<Node> parse() {
+        unique_ptr<Node> root = parseAlternation(0);
+        if (root && !atEnd()) return fail("unmatched )");
+        return root;
+    }
+    
+    const string& getError() const { return error; }
+};
+
+// ==================== NFA Construction ====================
+
+// Builds the states for node so that they continue at next, and returns
+// the entry state (-1 when the NFA grows too large). Reversed builds the
+// automaton for the pattern read right to left, where ^ and $ trade places.
+int Regex::compileNode(const Node& node, int next, bool reversed, vector<NfaState>& nfa) {
+    auto add = [&nfa](NfaState state) -> int {
+        if (nfa.size() >= MAX_NFA_STATES) return -1;
+        nfa.push_back(move(state));
+        return (int)nfa.size() - 1;
+    };
+    
+    switch (node.type) {
+        case Node::Chars: {
+            NfaState state(NfaState::Char);
+            state.chars = node.chars;
+            state.next.push_back(next);
+            return add(move(state));
+        }
+        
+        case Node::LineStart:
+        case Node::LineEnd: {
+            bool lineStart = (node.type == Node::LineStart) != reversed;
+            NfaState state(lineStart ? NfaState::LineStart : NfaState::LineEnd);
+            state.next.push_back(next);
+            return add(move(state));
+        }
+        
+        case Node::Concat:
+            if (reversed) {
+                for (size_t i = 0; i < node.children.size() && next >= 0; i++) {
+                    next = compileNode(*node.children[i], next, reversed, nfa);
+                }
+            } else {
+                for (size_t i = node.children.size(); i-- > 0 && next >= 0; ) {
+                    next = compileNode(*node.children[i], next, reversed, nfa);
+                }
+            }
+            return next;
+        
+        case Node::Alternate: {
+            NfaState split(NfaState::Split);
+            for (const auto& child : node.children) {
+                int branch = compileNode(*child, next, reversed, nfa);
+                if (branch < 0) return -1;
+                split.next.push_back(branch);
+            }
+            return add(move(split));
+        }
+        
+        case Node::Repeat:
+        default: {
+            const Node& child = *node.children[0];
+            int result = next;
+            
+            if (node.maxCount < 0) {
+                int loop = add(NfaState(NfaState::Split));
+                if (loop < 0) return -1;
+                int body = compileNode(child, loop, reversed, nfa);
+                if (body < 0) return -1;
+                nfa[loop].next.push_back(body);
+                nfa[loop].next.push_back(next);
+                result = loop;
+            } else {
+                // Optional copies nest: (x(x(x)?)?)?
+                for (int i = node.minCount; i < node.maxCount; i++) {
+                    int body = compileNode(child, result, reversed, nfa);
+                    if (body < 0) return -1;
+                    NfaState split(NfaState::Split);
+                    split.next.push_back(body);
+                    split.next.push_back(result);
+                    result = add(move(split));
+                    if (result < 0) return -1;
+                }
+            }
+            
+            for (int i = 0; i < node.minCount && result >= 0; i++) {
+                result = compileNode(child, result, reversed, nfa);
+            }
+            return result;
+        }
+    }
+}
+
+// ==================== LazyDfa Implementation ====================
+
+void Regex::LazyDfa::init(const vector<NfaState>* automaton, int start, bool restartEverywhere) {
+    nfa = automaton;
+    startNfa = start;
+    unanchored = restartEverywhere;
+    states.clear();
+    transitions.clear();
+    stateIds.clear();
+    visited.assign(nfa->size(), 0);
+    visitMark = 0;
+}
+
+// Replaces set with everything reachable through splits and the anchors
+// that hold here. Unpassed $ states are kept: a following '\n' or the end
+// of the text can still satisfy them.
+void Regex::LazyDfa::closure(vector<int>& set, bool lineStartOk, bool lineEndOk) const {
+    if (++visitMark == 0) {
+        fill(visited.begin(), visited.end(), 0);
+        visitMark = 1;
+    }
+    
+    vector<int> stack;
+    for (int s : set) {
+        if (visited[s] != visitMark) {
+            visited[s] = visitMark;
+            stack.push_back(s);
+        }
+    }
+    set.clear();
+    
+    while (!stack.empty()) {
+        int s = stack.back();
+        stack.pop_back();
+        const NfaState& state = (*nfa)[s];
+        
+        bool follow = state.type == NfaState::Split ||
+                      (state.type == NfaState::LineStart && lineStartOk) ||
+                      (state.type == NfaState::LineEnd && lineEndOk);
+        if (follow) {
+            for (int t : state.next) {
+                if (visited[t] != visitMark) {
+                    visited[t] = visitMark;
+                    stack.push_back(t);
+                }
+            }
+        } else if (state.type != NfaState::LineStart) {
+            set.push_back(s);
+        }
+    }
+    sort(set.begin(), set.end());
+}
+
+int Regex::LazyDfa::intern(vector<int>& set, bool afterNewline) {
+    pair<vector<int>, bool> key(set, afterNewline);
+    auto found = stateIds.find(key);
+    if (found != stateIds.end()) return found->second;
+    
+    // The accept state is always NFA state 0
+    State state;
+    state.afterNewline = afterNewline;
+    state.acceptAlways = binary_search(set.begin(), set.end(), 0);
+    state.acceptAtLineEnd = state.acceptAlways;
+    if (!state.acceptAlways) {
+        vector<int> atLineEnd = set;
+        closure(atLineEnd, afterNewline, true);
+        state.acceptAtLineEnd = binary_search(atLineEnd.begin(), atLineEnd.end(), 0);
+    }
+    state.dead = set.empty() && !unanchored;
+    state.nfaStates.swap(set);
+    
+    int id = states.size();
+    states.push_back(move(state));
+    transitions.resize(transitions.size() + 256, -1);
+    stateIds[key] = id;
+    return id;
+}
+
+int Regex::LazyDfa::startState(bool afterNewline) {
+    vector<int> set(1, startNfa);
+    closure(set, afterNewline, false);
+    if (states.size() >= MAX_STATES && stateIds.find(make_pair(set, afterNewline)) == stateIds.end()) {
+        states.clear();
+        transitions.clear();
+        stateIds.clear();
+    }
+    return intern(set, afterNewline);
+}
+
+int Regex::LazyDfa::buildTransition(int state, unsigned char c) {
+    bool newline = (c == '\n');
+    vector<int> current = states[state].nfaStates;
+    if (newline) {
+        closure(current, states[state].afterNewline, true);  // $ holds before a '\n'
+    }
+    
+    vector<int> next;
+    for (int s : current) {
+        const NfaState& nfaState = (*nfa)[s];
+        if (nfaState.type == NfaState::Char && nfaState.chars.test(c)) {
+            next.push_back(nfaState.next[0]);
+        }
+    }
+    if (unanchored) {
+        next.push_back(startNfa);
+    }
+    closure(next, newline, false);
+    
+    auto found = stateIds.find(make_pair(next, newline));
+    if (found != stateIds.end()) {
+        transitions[state * 256 + c] = found->second;
+        return found->second;
+    }
+    
+    // Cache full: start over from the state being entered
+    if (states.size() >= MAX_STATES) {
+        states.clear();
+        transitions.clear();
+        stateIds.clear();
+        return intern(next, newline);
+    }
+    
+    int id = intern(next, newline);
+    transitions[state * 256 + c] = id;
+    return id;
+}
+
+// ==================== Regex Implementation ====================
+
+shared_ptr<Regex> Regex::compile(const string& pattern, bool caseSensitive, string* error) {
+    Parser parser(pattern, caseSensitive);
+    unique_ptr<Node> root = parser.parse();
+    if (!root) {
+        if (error) *error = parser.getError();
+        return nullptr;
+    }
+    
+    shared_ptr<Regex> regex(new Regex());
+    regex->pattern = pattern;
+    regex->caseSensitive = caseSensitive;
+    
+    for (int reversed = 0; reversed < 2; reversed++) {
+        vector<NfaState>& nfa = reversed ? regex->reverseNfa : regex->forwardNfa;
+        nfa.push_back(NfaState(NfaState::Accept));
+        int start = compileNode(*root, 0, reversed == 1, nfa);
+        if (start < 0) {
+            if (error) *error = "pattern is too large";
+            return nullptr;
+        }
+        if (reversed) {
+            regex->reverse.init(&nfa, start, true);
+        } else {
+            regex->forwardStart = start;
+        }
+    }
+    return regex;
+}
+
+void Regex::addThread(vector<int>& list, vector<size_t>& startOf, int state, size_t start,
+                      bool lineStart, bool lineEnd, vector<int>& stack) const {
+    stack.push_back(state);
+    while (!stack.empty()) {
+        int s = stack.back();
+        stack.pop_back();
+        if (startOf[s] != NO_THREAD) continue;
+        startOf[s] = start;
+        list.push_back(s);  // splits and anchors too, so they are reset with the rest
+        
+        const NfaState& nfaState = forwardNfa[s];
+        bool follow = nfaState.type == NfaState::Split ||
+                      (nfaState.type == NfaState::LineStart && lineStart) ||
+                      (nfaState.type == NfaState::LineEnd && lineEnd);
+        if (follow) {
+            for (size_t k = nfaState.next.size(); k-- > 0; ) {
+                stack.push_back(nfaState.next[k]);
+            }
+        }
+    }
+}
+
+vector<Regex::Match> Regex::findAll(const string& text) const {
+    return findAll(BufferView(text));
+}
+
+vector<Regex::Match> Regex::findAll(const BufferView& view) const {
+    vector<Match> matches;
+    size_t n = view.length();
+    if (n == 0) return matches;
+    
+    // Pass 1, right to left with the reversed pattern: mark every position
+    // where some match starts. The byte before position i is read right
+    // after deciding about i, which is what a ^ there depends on.
+    vector<bool> starts(n, false);
+    int state = reverse.startState(true);
+    size_t i = n;
+    for (size_t s = view.getSpanCount(); s-- > 0; ) {
+        const TextSpan& span = view.getSpan(s);
+        for (size_t k = span.length; k-- > 0; i--) {
+            unsigned char c = span.data[k];
+            if (i < n && reverse.accepts(state, c == '\n')) {
+                starts[i] = true;
+            }
+            state = reverse.step(state, c);
+        }
+    }
+    if (reverse.accepts(state, true)) {
+        starts[0] = true;
+    }
+    
+    // Pass 2, left to right: a Pike VM over the forward NFA with a thread
+    // for each start marked above. Each NFA state holds one thread, the one
+    // with the earliest start, so the leftmost match always survives. Once
+    // a start s accepts at p, starts in (s, p) cannot begin a match and are
+    // dropped; a later start that lost a state to an earlier one shares its
+    // future, so it could only have matched where that one does.
+    vector<size_t> startOf(forwardNfa.size(), NO_THREAD);
+    vector<size_t> nextStartOf(forwardNfa.size(), NO_THREAD);
+    vector<int> current, next, stack;
+    vector<Match> pending;     // accepted, not yet final; the last end can still grow
+    size_t pendingFirst = 0;
+    size_t lastEnd = 0;        // no new match may start before this
+    
+    BufferView::const_iterator it = view.begin();
+    bool lineStart = true;
+    size_t p = 0;
+    while (true) {
+        bool lineEnd = (p == n || *it == '\n');
+        
+        // The accept state is always NFA state 0; empty matches do not count
+        size_t accepted = startOf[0];
+        if (accepted != NO_THREAD && accepted < p) {
+            while (pending.size() > pendingFirst && pending.back().position >= accepted) {
+                pending.pop_back();
+            }
+            pending.push_back(Match(accepted, p - accepted));
+            lastEnd = p;
+            
+            size_t kept = 0;
+            for (int s : current) {
+                if (startOf[s] > accepted && startOf[s] < p) {
+                    startOf[s] = NO_THREAD;
+                } else {
+                    current[kept++] = s;
+                }
+            }
+            current.resize(kept);
+        }
+        
+        // A pending match is final once no thread starts at or before it
+        size_t earliest = current.empty() ? NO_THREAD : startOf[current[0]];
+        while (pendingFirst < pending.size() && pending[pendingFirst].position < earliest) {
+            matches.push_back(pending[pendingFirst++]);
+        }
+        if (pendingFirst == pending.size()) {
+            pending.clear();
+            pendingFirst = 0;
+        }
+        
+        if (p == n) break;
+        if (starts[p] && p >= lastEnd) {
+            addThread(current, startOf, forwardStart, p, lineStart, lineEnd, stack);
+        }
+        
+        // No threads: skip to the next start
+        if (current.empty()) {
+            size_t q = p + 1;
+            while (q < n && !starts[q]) q++;
+            if (q >= n) break;
+            it += q - p - 1;
+            lineStart = (*it == '\n');
+            ++it;
+            p = q;
+            continue;
+        }
+        
+        unsigned char c = *it;
+        ++it;
+        p++;
+        lineStart = (c == '\n');
+        lineEnd = (p == n || *it == '\n');
+        for (int s : current) {
+            const NfaState& state = forwardNfa[s];
+            if (state.type == NfaState::Char && state.chars.test(c)) {
+                addThread(next, nextStartOf, state.next[0], startOf[s], lineStart, lineEnd, stack);
+            }
+            startOf[s] = NO_THREAD;
+        }
+        current.clear();
+        current.swap(next);
+        startOf.swap(nextStartOf);
+    }
+    
+    for (size_t k = pendingFirst; k < pending.size(); k++) {
+        matches.push_back(pending[k]);
+    }
+    
+    return matches;
+}
@@ -0,0 +1,320 @@
+#include "Rope.h"
+#include <algorithm>
+
+using namespace std;
+
+// ==================== RopeStorage Implementation ====================
+
+void RopeStorage::Node::update() {
+    if (isLeaf()) {
+        length = text.length();
+        newlines = countNewlines(text.data(), text.length());
+        height = 1;
+    } else {
+        length = left->length + right->length;
+        newlines = left->newlines + right->newlines;
+        height = max(left->height, right->height) + 1;
+    }
+}
+
+RopeStorage::RopeStorage() : root(nullptr) {}
+
+RopeStorage::~RopeStorage() {
+    destroy(root);
+}
+
+void RopeStorage::destroy(Node* node) {
+    if (!node) return;
+    destroy(node->left);
+    destroy(node->right);
+    delete node;
+}
+
+RopeStorage::Node* RopeStorage::build(const string& text, size_t begin, size_t end) {
+    if (end - begin <= LEAF_SIZE) {
+        return new Node(text.substr(begin, end - begin));
+    }
+    
+    // Split on a leaf boundary so every leaf but the last is LEAF_SIZE long
+    size_t leaves = (end - begin + LEAF_SIZE - 1) / LEAF_SIZE;
+    size_t mid = begin + (leaves / 2) * LEAF_SIZE;
+    return new Node(build(text, begin, mid), build(text, mid, end));
+}
+
+RopeStorage::Node* RopeStorage::rotateLeft(Node* node) {
+    Node* pivot = node->right;
+    node->right = pivot->left;
+    node->update();
+    pivot->left = node;
+    pivot->update();
+    return pivot;
+}
+
+RopeStorage::Node* RopeStorage::rotateRight(Node* node) {
+    Node* pivot = node->left;
+    node->left = pivot->right;
+    node->update();
+    pivot->right = node;
+    pivot->update();
+    return pivot;
+}
+
+RopeStorage::Node* RopeStorage::rebalance(Node* node) {
+    node->update();
+    int balance = height(node->left) - height(node->right);
+    
+    if (balance > 1) {
+        if (height(node->left->left) < height(node->left->right)) {
+            node->left = rotateLeft(node->left);
+        }
+        return rotateRight(node);
+    }
+    if (balance < -1) {
+        if (height(node->right->right) < height(node->right->left)) {
+            node->right = rotateRight(node->right);
+        }
+        return rotateLeft(node);
+    }
+    return node;
+}
+
+RopeStorage::Node* RopeStorage::join(Node* left, Node* right) {
+    if (!left) return right;
+    if (!right) return left;
+    
+    // Two short neighbouring leaves become one
+    if (left->isLeaf() && right->isLeaf() &&
+        left->length + right->length <= LEAF_SIZE) {
+        left->text += right->text;
+        left->update();
+        delete right;
+        return left;
+    }
+    
+    // Descend the taller side until the heights are close, then link
+    if (left->height > right->height + 1) {
+        left->right = join(left->right, right);
+        return rebalance(left);
+    }
+    if (right->height > left->height + 1) {
+        right->left = join(left, right->left);
+        return rebalance(right);
+    }
+    return new Node(left, right);
+}
+
+void RopeStorage::split(Node* node, size_t pos, Node*& left, Node*& right) {
+    if (!node) {
+        left = right = nullptr;
+        return;
+    }
+    if (pos == 0) {
+        left = nullptr;
+        right = node;
+        return;
+    }
+    if (pos >= node->length) {
+        left = node;
+        right = nullptr;
+        return;
+    }
+    
+    if (node->isLeaf()) {
+        right = new Node(node->text.substr(pos));
+        node->text.resize(pos);
+        node->update();
+        left = node;
+        return;
+    }
+    
+    Node* l = node->left;
+    Node* r = node->right;
+    delete node;
+    
+    if (pos < l->length) {
+        Node* a;
+        Node* b;
+        split(l, pos, a, b);
+        left = a;
+        right = join(b, r);
+    } else {
+        Node* a;
+        Node* b;
+        split(r, pos - l->length, a, b);
+        left = join(l, a);
+        right = b;
+    }
+}
+
+bool RopeStorage::insertInLeaf(Node* node, size_t pos, const string& text) {
+    if (node->isLeaf()) {
+        if (node->length + text.length() > MAX_LEAF_SIZE) return false;
+        node->text.insert(pos, text);
+        node->update();
+        return true;
+    }
+    
+    bool done = (pos <= node->left->length)
+        ? insertInLeaf(node->left, pos, text)
+        : insertInLeaf(node->right, pos - node->left->length, text);
+    if (done) {
+        node->update();
+    }
+    return done;
+}
+
+bool RopeStorage::deleteInLeaf(Node* node, size_t pos, size_t length) {
+    if (node->isLeaf()) {
+        if (length >= node->length) return false;  // never leave an empty leaf
+        node->text.erase(pos, length);
+        node->update();
+        return true;
+    }
+    
+    bool done = false;
+    if (pos + length <= node->left->length) {
+        done = deleteInLeaf(node->left, pos, length);
+    } else if (pos >= node->left->length) {
+        done = deleteInLeaf(node->right, pos - node->left->length, length);
+    }
+    if (done) {
+        node->update();
+    }
+    return done;
+}
+
+void RopeStorage::insert(size_t pos, const string& text) {
+    if (text.empty()) return;
+    pos = min(pos, length());
+    
+    if (!root) {
+        root = build(text, 0, text.length());
+        return;
+    }
+    
+    // Small edits are absorbed by the leaf that holds pos
+    if (insertInLeaf(root, pos, text)) return;
+    
+    Node* left;
+    Node* right;
+    split(root, pos, left, right);
+    root = join(join(left, build(text, 0, text.length())), right);
+}
+
+void RopeStorage::deleteText(size_t pos, size_t length) {
+    if (length == 0 || pos >= this->length()) return;
+    length = min(length, this->length() - pos);
+    
+    if (deleteInLeaf(root, pos, length)) return;
+    
+    Node* left;
+    Node* middle;
+    Node* right;
+    split(root, pos, left, right);
+    split(right, length, middle, right);
+    destroy(middle);
+    root = join(left, right);
+}
+
+void RopeStorage::collect(const Node* node, size_t pos, size_t length, string& out) {
+    if (!node || length == 0) return;
+    
+    if (node->isLeaf()) {
+        out.append(node->text, pos, length);
+        return;
+    }
+    
+    size_t leftLength = node->left->length;
+    if (pos < leftLength) {
+        size_t take = min(length, leftLength - pos);
+        collect(node->left, pos, take, out);
+        collect(node->right, 0, length - take, out);
+    } else {
+        collect(node->right, pos - leftLength, length, out);
+    }
+}
+
+void RopeStorage::collectSpans(const Node* node, vector<TextSpan>& spans) {
+    if (!node) return;
+    
+    if (node->isLeaf()) {
+        spans.push_back(TextSpan(node->text.data(), node->text.length()));
+        return;
+    }
+    
+    collectSpans(node->left, spans);
+    collectSpans(node->right, spans);
+}
+
+void RopeStorage::getSpans(vector<TextSpan>& spans) const {
+    collectSpans(root, spans);
+}
+
+string RopeStorage::getText() const {
+    return getSubstring(0, length());
+}
+
+string RopeStorage::getSubstring(size_t pos, size_t length) const {
+    if (pos >= this->length()) return "";
+    length = min(length, this->length() - pos);
+    
+    string result;
+    result.reserve(length);
+    collect(root, pos, length, result);
+    return result;
+}
+
+void RopeStorage::clear() {
+    destroy(root);
+    root = nullptr;
+}
+
+void RopeStorage::setText(const string& text) {
+    clear();
+    if (!text.empty()) {
+        root = build(text, 0, text.length());
+    }
+}
+
+size_t RopeStorage::countNewlinesBefore(size_t pos) const {
+    size_t count = 0;
+    const Node* node = root;
+    while (node && pos < node->length) {
+        if (node->isLeaf()) {
+            return count + countNewlines(node->text.data(), pos);
+        }
+        if (pos < node->left->length) {
+            node = node->left;
+        } else {
+            count += node->left->newlines;
+            pos -= node->left->length;
+            node = node->right;
+        }
+    }
+    return count + (node ? node->newlines : 0);
+}
+
+size_t RopeStorage::findNewline(size_t n) const {
+    if (!root || n == 0 || n > root->newlines) {
+        return length();
+    }
+    
+    // Walk down by newline counts, then scan the leaf
+    size_t pos = 0;
+    const Node* node = root;
+    while (!node->isLeaf()) {
+        if (n <= node->left->newlines) {
+            node = node->left;
+        } else {
+            n -= node->left->newlines;
+            pos += node->left->length;
+            node = node->right;
+        }
+    }
+    
+    size_t offset = 0;
+    for (; ; offset++) {
+        if (node->text[offset] == '\n' && --n == 0) break;
+    }
+    return pos + offset;
+}
@@ -0,0 +1,329 @@
+#include "SimdScan.h"
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 code inside functions marked for it, so the
+// rest of the program still runs on CPUs without it
+#if defined(__GNUC__)
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+using namespace std;
+
+// ==================== CPU Detection ====================
+
+#ifdef SIMD_SCAN_X86
+static SimdLevel queryCpu() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osSavesYmm) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse2 = __builtin_cpu_supports("sse2");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) return SimdLevel::AVX2;
+    if (sse2) return SimdLevel::SSE2;
+    return SimdLevel::Scalar;
+}
+#endif
+
+SimdLevel detectSimdLevel() {
+#ifdef SIMD_SCAN_X86
+    static const SimdLevel level = queryCpu();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2:
+            return "AVX2";
+        case SimdLevel::SSE2:
+            return "SSE2";
+        case SimdLevel::Best:
+            return simdLevelName(detectSimdLevel());
+        case SimdLevel::Scalar:
+        default:
+            return "scalar";
+    }
+}
+
+// ==================== Scanners ====================
+
+// A prepared pattern. With ignoreCase the pattern is lowercased and the fold
+// masks are 0x20 where its first/last byte is a letter: (byte | fold) then
+// equals the lowered byte for exactly the two cases of that letter, so one
+// OR per block is all the filter needs. Case-sensitive scans use 0.
+struct ScanPattern {
+    string bytes;
+    bool ignoreCase;
+    unsigned char firstFold;
+    unsigned char lastFold;
+};
+
+static inline unsigned char foldAscii(unsigned char c) {
+    return ((unsigned)(c - 'A') < 26) ? (c | 0x20) : c;
+}
+
+static ScanPattern prepare(const string& pattern, bool ignoreCase) {
+    ScanPattern prepared;
+    prepared.bytes = pattern;
+    prepared.ignoreCase = ignoreCase;
+    prepared.firstFold = 0;
+    prepared.lastFold = 0;
+    if (ignoreCase) {
+        for (char& c : prepared.bytes) {
+            c = foldAscii(c);
+        }
+        unsigned char first = prepared.bytes[0];
+        unsigned char last = prepared.bytes[prepared.bytes.length() - 1];
+        prepared.firstFold = (first >= 'a' && first <= 'z') ? 0x20 : 0;
+        prepared.lastFold = (last >= 'a' && last <= 'z') ? 0x20 : 0;
+    }
+    return prepared;
+}
+
+// text[0, length) against the lowered pattern bytes
+static inline bool equalsFolded(const char* text, const char* lowered, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (foldAscii(text[i]) != (unsigned char)lowered[i]) return false;
+    }
+    return true;
+}
+
+#ifdef SIMD_SCAN_X86
+// Lowercases a block at a time: 'A'..'Z' are the bytes whose distance from
+// 'A' is below 26, compared unsigned by flipping the sign bits. Each
+// scanner calls the version built for its own instruction set, since
+// mixing legacy SSE with AVX code stalls on the register state switch.
+SIMD_TARGET("sse2")
+static bool equalsFoldedSSE2(const char* text, const char* lowered, size_t length) {
+    const __m128i signBit = _mm_set1_epi8((char)0x80);
+    const __m128i upperA = _mm_set1_epi8('A');
+    const __m128i letters = _mm_set1_epi8((char)(26 - 128));
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i offset = _mm_xor_si128(_mm_sub_epi8(block, upperA), signBit);
+        __m128i upper = _mm_cmplt_epi8(offset, letters);
+        __m128i folded = _mm_or_si128(block, _mm_and_si128(upper, caseBit));
+        __m128i expected = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lowered + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(folded, expected)) != 0xFFFF) return false;
+    }
+    return equalsFolded(text + i, lowered + i, length - i);
+}
+
+SIMD_TARGET("avx2")
+static bool equalsFoldedAVX2(const char* text, const char* lowered, size_t length) {
+    const __m256i signBit = _mm256_set1_epi8((char)0x80);
+    const __m256i upperA = _mm256_set1_epi8('A');
+    const __m256i letters = _mm256_set1_epi8((char)(26 - 128));
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i offset = _mm256_xor_si256(_mm256_sub_epi8(block, upperA), signBit);
+        __m256i upper = _mm256_cmpgt_epi8(letters, offset);
+        __m256i folded = _mm256_or_si256(block, _mm256_and_si256(upper, caseBit));
+        __m256i expected = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lowered + i));
+        if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(folded, expected)) != 0xFFFFFFFFu) return false;
+    }
+    return equalsFolded(text + i, lowered + i, length - i);
+}
+#endif
+
+// Each scanner handles the windows starting in [from, textLength - m] and
+// returns where it stopped so the caller can finish the tail
+
+static size_t scanScalar(const char* text, size_t textLength, const ScanPattern& pattern,
+                         size_t from, vector<size_t>& positions, size_t base) {
+    size_t m = pattern.bytes.length();
+    const char* p = pattern.bytes.data();
+    unsigned char first = p[0];
+    unsigned char last = p[m - 1];
+    size_t lastStart = textLength - m;
+    
+    size_t i = from;
+    while (i <= lastStart) {
+        if (pattern.firstFold == 0) {
+            const char* hit = static_cast<const char*>(memchr(text + i, first, lastStart - i + 1));
+            if (!hit) break;
+            i = hit - text;
+        } else if (((unsigned char)text[i] | pattern.firstFold) != first) {
+            i++;
+            continue;
+        }
+        if (((unsigned char)text[i + m - 1] | pattern.lastFold) == last &&
+            (m <= 2 || (pattern.ignoreCase ? equalsFolded(text + i + 1, p + 1, m - 2)
+                                           : memcmp(text + i + 1, p + 1, m - 2) == 0))) {
+            positions.push_back(base + i);
+        }
+        i++;
+    }
+    return lastStart + 1;
+}
+
+#ifdef SIMD_SCAN_X86
+static inline unsigned lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+SIMD_TARGET("sse2")
+static size_t scanSSE2(const char* text, size_t textLength, const ScanPattern& pattern,
+                       vector<size_t>& positions, size_t base) {
+    size_t m = pattern.bytes.length();
+    const char* p = pattern.bytes.data();
+    const __m128i first = _mm_set1_epi8(p[0]);
+    const __m128i last = _mm_set1_epi8(p[m - 1]);
+    const __m128i firstFold = _mm_set1_epi8((char)pattern.firstFold);
+    const __m128i lastFold = _mm_set1_epi8((char)pattern.lastFold);
+    
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= textLength; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, _mm_or_si128(blockFirst, firstFold)),
+                          _mm_cmpeq_epi8(last, _mm_or_si128(blockLast, lastFold))));
+        while (mask) {
+            unsigned bit = lowestBit(mask);
+            const char* middle = text + i + bit + 1;
+            if (m <= 2 || (pattern.ignoreCase ? equalsFoldedSSE2(middle, p + 1, m - 2)
+                                              : memcmp(middle, p + 1, m - 2) == 0)) {
+                positions.push_back(base + i + bit);
+            }
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+
+SIMD_TARGET("avx2")
+static size_t scanAVX2(const char* text, size_t textLength, const ScanPattern& pattern,
+                       vector<size_t>& positions, size_t base) {
+    size_t m = pattern.bytes.length();
+    const char* p = pattern.bytes.data();
+    const __m256i first = _mm256_set1_epi8(p[0]);
+    const __m256i last = _mm256_set1_epi8(p[m - 1]);
+    const __m256i firstFold = _mm256_set1_epi8((char)pattern.firstFold);
+    const __m256i lastFold = _mm256_set1_epi8((char)pattern.lastFold);
+    
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= textLength; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + m - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, _mm256_or_si256(blockFirst, firstFold)),
+                             _mm256_cmpeq_epi8(last, _mm256_or_si256(blockLast, lastFold))));
+        while (mask) {
+            unsigned bit = lowestBit(mask);
+            const char* middle = text + i + bit + 1;
+            if (m <= 2 || (pattern.ignoreCase ? equalsFoldedAVX2(middle, p + 1, m - 2)
+                                              : memcmp(middle, p + 1, m - 2) == 0)) {
+                positions.push_back(base + i + bit);
+            }
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+#endif
+
+// ==================== findOccurrences Implementation ====================
+
+static void scanText(const char* text, size_t textLength, const ScanPattern& pattern,
+                     vector<size_t>& positions, size_t base, SimdLevel level) {
+    if (pattern.bytes.length() > textLength) return;
+    
+    level = min(level, detectSimdLevel());
+    size_t done = 0;
+#ifdef SIMD_SCAN_X86
+    if (level == SimdLevel::AVX2) {
+        done = scanAVX2(text, textLength, pattern, positions, base);
+    } else if (level == SimdLevel::SSE2) {
+        done = scanSSE2(text, textLength, pattern, positions, base);
+    }
+#endif
+    scanScalar(text, textLength, pattern, done, positions, base);
+}
+
+static void scanView(const BufferView& view, const ScanPattern& pattern, vector<size_t>& positions,
+                     SimdLevel level) {
+    size_t m = pattern.bytes.length();
+    if (m > view.length()) return;
+    
+    for (size_t s = 0; s < view.getSpanCount(); s++) {
+        const TextSpan& span = view.getSpan(s);
+        size_t spanStart = view.getSpanOffset(s);
+        scanText(span.data, span.length, pattern, positions, spanStart, level);
+        
+        // Matches that start in this span and run past its end
+        size_t boundary = spanStart + span.length;
+        if (m == 1 || span.length == 0 || boundary >= view.length()) continue;
+        
+        size_t windowStart = max(spanStart, boundary - min(boundary, m - 1));
+        string window = view.substr(windowStart, (boundary - windowStart) + m - 1);
+        vector<size_t> straddling;
+        scanText(window.data(), window.length(), pattern, straddling, windowStart, level);
+        for (size_t pos : straddling) {
+            if (pos < boundary && pos + m > boundary) {
+                positions.push_back(pos);
+            }
+        }
+    }
+}
+
+void findOccurrences(const char* text, size_t textLength, const string& pattern,
+                     vector<size_t>& positions, size_t base, SimdLevel level) {
+    if (pattern.empty()) return;
+    scanText(text, textLength, prepare(pattern, false), positions, base, level);
+}
+
+void findOccurrences(const BufferView& view, const string& pattern, vector<size_t>& positions,
+                     SimdLevel level) {
+    if (pattern.empty()) return;
+    scanView(view, prepare(pattern, false), positions, level);
+}
+
+void findOccurrencesIgnoreCase(const char* text, size_t textLength, const string& pattern,
+                               vector<size_t>& positions, size_t base, SimdLevel level) {
+    if (pattern.empty()) return;
+    scanText(text, textLength, prepare(pattern, true), positions, base, level);
+}
+
+void findOccurrencesIgnoreCase(const BufferView& view, const string& pattern,
+                               vector<size_t>& positions, SimdLevel level) {
+    if (pattern.empty()) return;
+    scanView(view, prepare(pattern, true), positions, level);
+}
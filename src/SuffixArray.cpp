@@ -0,0 +1,266 @@
+#include "SuffixArray.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// ==================== SA-IS ====================
+
+// Suffix array of s[0, n) over symbols 0..upper (Nong, Zhang and Chan).
+// Suffixes are typed S (smaller than the next suffix) or L; the leftmost
+// S of each run (LMS) is sorted first, recursively on a reduced string when
+// two LMS substrings are equal, and the order of all suffixes is induced
+// from theirs in two scans.
+template <typename Symbol>
+static vector<int32_t> saIs(const Symbol* s, int32_t n, int32_t upper) {
+    vector<int32_t> sa(n);
+    if (n == 0) return sa;
+    if (n == 1) {
+        sa[0] = 0;
+        return sa;
+    }
+    if (n == 2) {
+        sa[0] = (s[0] < s[1]) ? 0 : 1;
+        sa[1] = 1 - sa[0];
+        return sa;
+    }
+    
+    vector<unsigned char> isS(n, 0);
+    for (int32_t i = n - 2; i >= 0; i--) {
+        isS[i] = (s[i] == s[i + 1]) ? isS[i + 1] : (s[i] < s[i + 1]);
+    }
+    
+    // Bucket starts: L suffixes of a symbol come before its S suffixes
+    vector<int32_t> startL(upper + 1, 0), startS(upper + 1, 0);
+    for (int32_t i = 0; i < n; i++) {
+        if (!isS[i]) {
+            startS[s[i]]++;
+        } else {
+            startL[s[i] + 1]++;
+        }
+    }
+    for (int32_t c = 0; c <= upper; c++) {
+        startS[c] += startL[c];
+        if (c < upper) startL[c + 1] += startS[c];
+    }
+    
+    vector<int32_t> bucket(upper + 1);
+    auto induce = [&](const vector<int32_t>& lms) {
+        fill(sa.begin(), sa.end(), -1);
+        copy(startS.begin(), startS.end(), bucket.begin());
+        for (int32_t d : lms) {
+            if (d == n) continue;
+            sa[bucket[s[d]]++] = d;
+        }
+        copy(startL.begin(), startL.end(), bucket.begin());
+        sa[bucket[s[n - 1]]++] = n - 1;
+        for (int32_t i = 0; i < n; i++) {
+            int32_t v = sa[i];
+            if (v >= 1 && !isS[v - 1]) {
+                sa[bucket[s[v - 1]]++] = v - 1;
+            }
+        }
+        copy(startL.begin(), startL.end(), bucket.begin());
+        for (int32_t i = n - 1; i >= 0; i--) {
+            int32_t v = sa[i];
+            if (v >= 1 && isS[v - 1]) {
+                sa[--bucket[s[v - 1] + 1]] = v - 1;
+            }
+        }
+    };
+    
+    vector<int32_t> lmsIndex(n + 1, -1);
+    vector<int32_t> lms;
+    for (int32_t i = 1; i < n; i++) {
+        if (!isS[i - 1] && isS[i]) {
+            lmsIndex[i] = lms.size();
+            lms.push_back(i);
+        }
+    }
+    int32_t m = lms.size();
+    
+    induce(lms);
+    if (m == 0) return sa;
+    
+    // Name the LMS substrings in induced order; equal names need recursion
+    vector<int32_t> sortedLms;
+    sortedLms.reserve(m);
+    for (int32_t v : sa) {
+        if (lmsIndex[v] != -1) sortedLms.push_back(v);
+    }
+    vector<int32_t> reduced(m);
+    int32_t reducedUpper = 0;
+    reduced[lmsIndex[sortedLms[0]]] = 0;
+    for (int32_t i = 1; i < m; i++) {
+        int32_t l = sortedLms[i - 1];
+        int32_t r = sortedLms[i];
+        int32_t endL = (lmsIndex[l] + 1 < m) ? lms[lmsIndex[l] + 1] : n;
+        int32_t endR = (lmsIndex[r] + 1 < m) ? lms[lmsIndex[r] + 1] : n;
+        bool same = true;
+        if (endL - l != endR - r) {
+            same = false;
+        } else {
+            while (l < endL && s[l] == s[r]) {
+                l++;
+                r++;
+            }
+            if (l == n || s[l] != s[r]) same = false;
+        }
+        if (!same) reducedUpper++;
+        reduced[lmsIndex[sortedLms[i]]] = reducedUpper;
+    }
+    
+    vector<int32_t> reducedSa = saIs(reduced.data(), m, reducedUpper);
+    for (int32_t i = 0; i < m; i++) {
+        sortedLms[i] = lms[reducedSa[i]];
+    }
+    induce(sortedLms);
+    return sa;
+}
+
+// ==================== SuffixArray Implementation ====================
+
+bool SuffixArray::build(const TextBuffer& buffer) {
+    if (buffer.length() > MAX_TEXT_LENGTH) {
+        clear();
+        return false;
+    }
+    bool ok = build(buffer.getText());
+    version = buffer.getVersion();
+    return ok;
+}
+
+bool SuffixArray::build(string document) {
+    clear();
+    if (document.length() > MAX_TEXT_LENGTH) {
+        return false;
+    }
+    
+    text = move(document);
+    int32_t n = text.length();
+    suffixes = saIs(reinterpret_cast<const unsigned char*>(text.data()), n, 255);
+    if (n == 0) {
+        built = true;
+        return true;
+    }
+    
+    // LCP with Kasai's bound: walking suffixes in text order, the common
+    // prefix with the preceding suffix in sorted order shrinks by at most
+    // one per step. phi[i] is that preceding suffix; computing the LCPs in
+    // text order first and permuting once keeps the scan mostly sequential.
+    vector<int32_t> phi(n);
+    phi[suffixes[0]] = -1;
+    for (int32_t i = 1; i < n; i++) {
+        phi[suffixes[i]] = suffixes[i - 1];
+    }
+    int32_t h = 0;
+    for (int32_t i = 0; i < n; i++) {
+        int32_t j = phi[i];
+        if (j < 0) {
+            phi[i] = 0;
+            h = 0;
+            continue;
+        }
+        while (i + h < n && j + h < n && text[i + h] == text[j + h]) {
+            h++;
+        }
+        phi[i] = h;  // now the LCP of suffix i, by text position
+        if (h > 0) h--;
+    }
+    lcp.resize(n);
+    for (int32_t i = 0; i < n; i++) {
+        lcp[i] = phi[suffixes[i]];
+    }
+    
+    built = true;
+    return true;
+}
+
+void SuffixArray::clear() {
+    string().swap(text);
+    vector<int32_t>().swap(suffixes);
+    vector<int32_t>().swap(lcp);
+    version = 0;
+    built = false;
+}
+
+int SuffixArray::comparePrefix(size_t start, const string& pattern) const {
+    size_t available = text.length() - start;
+    int cmp = memcmp(text.data() + start, pattern.data(), min(available, pattern.length()));
+    if (cmp != 0) return cmp;
+    return (available < pattern.length()) ? -1 : 0;
+}
+
+vector<size_t> SuffixArray::find(const string& pattern) const {
+    vector<size_t> positions;
+    if (!built || pattern.empty() || pattern.length() > text.length()) {
+        return positions;
+    }
+    
+    // First suffix not less than the pattern
+    size_t lo = 0, hi = suffixes.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (comparePrefix(suffixes[mid], pattern) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == suffixes.size() || comparePrefix(suffixes[lo], pattern) != 0) {
+        return positions;
+    }
+    
+    // Following suffixes match while they share the whole pattern
+    size_t end = lo + 1;
+    while (end < suffixes.size() && (size_t)lcp[end] >= pattern.length()) {
+        end++;
+    }
+    for (size_t i = lo; i < end; i++) {
+        positions.push_back(suffixes[i]);
+    }
+    sort(positions.begin(), positions.end());
+    return positions;
+}
+
+size_t SuffixArray::count(const string& pattern) const {
+    if (!built || pattern.empty() || pattern.length() > text.length()) {
+        return 0;
+    }
+    
+    size_t first = 0, hi = suffixes.size();
+    while (first < hi) {
+        size_t mid = first + (hi - first) / 2;
+        if (comparePrefix(suffixes[mid], pattern) < 0) {
+            first = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t last = first;
+    hi = suffixes.size();
+    while (last < hi) {
+        size_t mid = last + (hi - last) / 2;
+        if (comparePrefix(suffixes[mid], pattern) <= 0) {
+            last = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return last - first;
+}
+
+void SuffixArray::longestRepeat(size_t& position, size_t& length) const {
+    position = 0;
+    length = 0;
+    for (size_t i = 1; i < lcp.size(); i++) {
+        if ((size_t)lcp[i] > length) {
+            length = lcp[i];
+            position = suffixes[i];
+        }
+    }
+}
+
+size_t SuffixArray::memoryUsage() const {
+    return text.capacity() + (suffixes.capacity() + lcp.capacity()) * sizeof(int32_t);
+}
@@ -0,0 +1,74 @@
+#include "ThreadPool.h"
+
+using namespace std;
+
+// ==================== ThreadPool Implementation ====================
+
+ThreadPool::ThreadPool(size_t threads)
+    : task(nullptr), taskCount(0), nextTask(0), pending(0), generation(0), stopping(false) {
+    for (size_t i = 1; i < threads; i++) {
+        workers.push_back(thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::hardwareThreads() {
+    unsigned int cores = thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+void ThreadPool::workerLoop() {
+    uint64_t seen = 0;
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        runTasks(guard);
+    }
+}
+
+void ThreadPool::runTasks(unique_lock<mutex>& guard) {
+    while (task && nextTask < taskCount) {
+        size_t index = nextTask++;
+        const function<void(size_t)>& body = *task;
+        guard.unlock();
+        body(index);
+        guard.lock();
+        if (--pending == 0) {
+            done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)>& body) {
+    if (workers.empty() || count <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+    
+    lock_guard<mutex> serial(runLock);
+    unique_lock<mutex> guard(lock);
+    task = &body;
+    taskCount = count;
+    nextTask = 0;
+    pending = count;
+    generation++;
+    wake.notify_all();
+    
+    runTasks(guard);
+    done.wait(guard, [&] { return pending == 0; });
+    task = nullptr;
+}
@@ -0,0 +1,552 @@
+#include "TrigramIndex.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef S_ISREG  // MSVC has only the mask
+#define S_ISREG(mode) (((mode) & _S_IFMT) == _S_IFREG)
+#endif
+#else
+#include <dirent.h>
+#endif
+
+using namespace std;
+
+const char* const TrigramIndex::LOG_NAME = ".trigram_index";
+
+static const char LOG_MAGIC[8] = {'T', 'R', 'I', 'G', 'R', 'A', 'M', '1'};
+
+// Records are written in host byte order; the log is a cache of the
+// directory and is rebuilt from it if it cannot be read
+template <typename T>
+static void putValue(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool getValue(const string& in, size_t& pos, T& value) {
+    if (in.length() - pos < sizeof(T)) return false;
+    memcpy(&value, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+static void putArray(string& out, const vector<uint32_t>& values) {
+    putValue<uint32_t>(out, values.size());
+    if (!values.empty()) {
+        out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(uint32_t));
+    }
+}
+
+static bool getArray(const string& in, size_t& pos, vector<uint32_t>& values) {
+    uint32_t count;
+    if (!getValue(in, pos, count) || (in.length() - pos) / sizeof(uint32_t) < count) return false;
+    values.resize(count);
+    if (count > 0) {
+        memcpy(values.data(), in.data() + pos, count * sizeof(uint32_t));
+    }
+    pos += count * sizeof(uint32_t);
+    return true;
+}
+
+static bool statFile(const string& path, uint64_t& size, int64_t& modified) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) return false;
+    size = info.st_size;
+    modified = info.st_mtime;
+    return true;
+}
+
+// Names of the entries directly inside dir
+static vector<string> listDirectory(const string& dir) {
+    vector<string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE handle = FindFirstFileA((dir + "\\*").c_str(), &found);
+    if (handle == INVALID_HANDLE_VALUE) return names;
+    do {
+        if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            names.push_back(found.cFileName);
+        }
+    } while (FindNextFileA(handle, &found));
+    FindClose(handle);
+#else
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) return names;
+    while (dirent* entry = readdir(handle)) {
+        names.push_back(entry->d_name);
+    }
+    closedir(handle);
+#endif
+    return names;
+}
+
+// Hidden files (the log itself) and temp files of in-progress saves
+static bool isIndexable(const string& name) {
+    if (name.empty() || name[0] == '.') return false;
+    return !(name.length() >= 4 && name.compare(name.length() - 4, 4, ".tmp") == 0);
+}
+
+static uint32_t foldByte(char c) {
+    return (unsigned char)tolower((unsigned char)c);
+}
+
+// ==================== TrigramIndex Implementation ====================
+
+TrigramIndex::TrigramIndex(const string& dir)
+    : directory(dir), logPath(dir + "/" + LOG_NAME), liveFiles(0), logSize(0), liveBytes(0) {}
+
+TrigramIndex::~TrigramIndex() {
+    if (log.is_open()) {
+        log.close();
+    }
+}
+
+string TrigramIndex::relativeName(const string& path) const {
+    if (path.length() <= directory.length() + 1 ||
+        path.compare(0, directory.length(), directory) != 0 ||
+        (path[directory.length()] != '/' && path[directory.length()] != '\\')) {
+        return "";
+    }
+    string name = path.substr(directory.length() + 1);
+    if (name.find_first_of("/\\") != string::npos || !isIndexable(name)) {
+        return "";
+    }
+    return name;
+}
+
+uint32_t TrigramIndex::getFileId(const string& name) {
+    auto found = fileIds.find(name);
+    if (found != fileIds.end()) {
+        return found->second;
+    }
+    uint32_t id = files.size();
+    files.push_back(FileEntry());
+    files.back().name = name;
+    fileIds[name] = id;
+    return id;
+}
+
+void TrigramIndex::indexText(FileEntry& entry, const BufferView& text) const {
+    entry.trigrams.clear();
+    entry.offsetStart.clear();
+    entry.offsets.clear();
+    entry.indexed = max(entry.size, (uint64_t)text.length()) <= MAX_INDEXED_SIZE;
+    if (!entry.indexed) return;
+    
+    // (trigram << 32 | offset) for every position, sorted, then grouped;
+    // the window carries across span boundaries
+    vector<uint64_t> occurrences;
+    occurrences.reserve(text.length() >= 3 ? text.length() - 2 : 0);
+    uint32_t window = 0;
+    size_t pos = 0;
+    for (size_t i = 0; i < text.getSpanCount(); i++) {
+        const TextSpan& span = text.getSpan(i);
+        for (size_t j = 0; j < span.length; j++, pos++) {
+            window = ((window << 8) | foldByte(span.data[j])) & 0xFFFFFF;
+            if (pos >= 2) {
+                occurrences.push_back((uint64_t)window << 32 | (pos - 2));
+            }
+        }
+    }
+    sort(occurrences.begin(), occurrences.end());
+    
+    entry.offsets.reserve(occurrences.size());
+    for (size_t i = 0; i < occurrences.size(); i++) {
+        uint32_t trigram = occurrences[i] >> 32;
+        if (entry.trigrams.empty() || entry.trigrams.back() != trigram) {
+            entry.trigrams.push_back(trigram);
+            entry.offsetStart.push_back(i);
+        }
+        entry.offsets.push_back((uint32_t)occurrences[i]);
+    }
+    entry.offsetStart.push_back(entry.offsets.size());
+}
+
+void TrigramIndex::setEntry(uint32_t id, FileEntry& entry) {
+    FileEntry& old = files[id];
+    if (old.live) {
+        for (uint32_t trigram : old.trigrams) {
+            auto list = postings.find(trigram);
+            if (list == postings.end()) continue;
+            auto it = lower_bound(list->second.begin(), list->second.end(), id);
+            if (it != list->second.end() && *it == id) {
+                list->second.erase(it);
+            }
+            if (list->second.empty()) {
+                postings.erase(list);
+            }
+        }
+        liveFiles--;
+        liveBytes -= old.recordBytes;
+    }
+    
+    entry.name = old.name;
+    old = move(entry);
+    
+    if (old.live) {
+        for (uint32_t trigram : old.trigrams) {
+            vector<uint32_t>& list = postings[trigram];
+            list.insert(lower_bound(list.begin(), list.end(), id), id);
+        }
+        liveFiles++;
+        liveBytes += old.recordBytes;
+    }
+}
+
+pair<const uint32_t*, const uint32_t*> TrigramIndex::findOffsets(const FileEntry& entry,
+                                                                 uint32_t trigram) const {
+    auto it = lower_bound(entry.trigrams.begin(), entry.trigrams.end(), trigram);
+    if (it == entry.trigrams.end() || *it != trigram) {
+        return make_pair(nullptr, nullptr);
+    }
+    size_t i = it - entry.trigrams.begin();
+    const uint32_t* base = entry.offsets.data();
+    return make_pair(base + entry.offsetStart[i], base + entry.offsetStart[i + 1]);
+}
+
+bool TrigramIndex::mayContain(const FileEntry& entry,
+                              const vector<pair<uint32_t, size_t>>& patternTrigrams) const {
+    // Every trigram must occur at the same distance from one start position
+    // as in the pattern. The trigram with the fewest offsets proposes starts.
+    vector<pair<const uint32_t*, const uint32_t*>> ranges;
+    size_t anchor = 0;
+    for (size_t i = 0; i < patternTrigrams.size(); i++) {
+        ranges.push_back(findOffsets(entry, patternTrigrams[i].first));
+        if (ranges[i].first == ranges[i].second) return false;
+        if (ranges[i].second - ranges[i].first < ranges[anchor].second - ranges[anchor].first) {
+            anchor = i;
+        }
+    }
+    
+    size_t anchorOffset = patternTrigrams[anchor].second;
+    for (const uint32_t* it = ranges[anchor].first; it != ranges[anchor].second; ++it) {
+        if (*it < anchorOffset) continue;
+        size_t start = *it - anchorOffset;
+        
+        bool all = true;
+        for (size_t i = 0; i < patternTrigrams.size() && all; i++) {
+            if (i == anchor) continue;
+            all = binary_search(ranges[i].first, ranges[i].second,
+                                (uint32_t)(start + patternTrigrams[i].second));
+        }
+        if (all) return true;
+    }
+    return false;
+}
+
+string TrigramIndex::encodeRecord(const FileEntry& entry) const {
+    string record;
+    putValue<uint8_t>(record, entry.live);
+    putValue<uint32_t>(record, entry.name.length());
+    record += entry.name;
+    if (entry.live) {
+        putValue<uint64_t>(record, entry.size);
+        putValue<int64_t>(record, entry.modified);
+        putValue<uint8_t>(record, entry.indexed);
+        putArray(record, entry.trigrams);
+        putArray(record, entry.offsetStart);
+        putArray(record, entry.offsets);
+    }
+    return record;
+}
+
+bool TrigramIndex::decodeRecord(const string& record, FileEntry& entry) const {
+    size_t pos = 0;
+    uint8_t live, indexed;
+    uint32_t nameLength;
+    if (!getValue(record, pos, live) || !getValue(record, pos, nameLength) ||
+        record.length() - pos < nameLength) {
+        return false;
+    }
+    entry.name = record.substr(pos, nameLength);
+    pos += nameLength;
+    entry.live = live != 0;
+    if (!entry.live) return pos == record.length();
+    
+    if (!getValue(record, pos, entry.size) || !getValue(record, pos, entry.modified) ||
+        !getValue(record, pos, indexed) || !getArray(record, pos, entry.trigrams) ||
+        !getArray(record, pos, entry.offsetStart) || !getArray(record, pos, entry.offsets)) {
+        return false;
+    }
+    entry.indexed = indexed != 0;
+    
+    // Reject anything the lookups could read out of bounds with
+    if (entry.offsetStart.size() != entry.trigrams.size() + (entry.indexed ? 1 : 0) ||
+        (entry.indexed && (entry.offsetStart.front() != 0 ||
+                           entry.offsetStart.back() != entry.offsets.size() ||
+                           !is_sorted(entry.offsetStart.begin(), entry.offsetStart.end())))) {
+        return false;
+    }
+    entry.recordBytes = sizeof(uint32_t) + record.length();
+    return pos == record.length();
+}
+
+bool TrigramIndex::appendRecord(const string& record) {
+    if (!log.is_open()) return false;
+    
+    string framed;
+    putValue<uint32_t>(framed, record.length());
+    framed += record;
+    log.write(framed.data(), framed.length());
+    log.flush();
+    if (!log) {
+        log.close();  // the next open() re-indexes what was missed
+        return false;
+    }
+    logSize += framed.length();
+    return true;
+}
+
+bool TrigramIndex::loadLog() {
+    ifstream in(logPath, ios::binary);
+    if (!in.is_open()) return false;
+    
+    char magic[sizeof(LOG_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0) {
+        return false;
+    }
+    logSize = sizeof(LOG_MAGIC);
+    
+    // A torn or damaged record (e.g. a crash during append) ends the replay
+    string record;
+    uint32_t length;
+    while (in.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+        record.resize(length);
+        if (length > 0 && !in.read(&record[0], length)) return false;
+        
+        FileEntry entry;
+        if (!decodeRecord(record, entry) || !isIndexable(entry.name)) return false;
+        setEntry(getFileId(entry.name), entry);
+        logSize += sizeof(length) + length;
+    }
+    return in.eof() && in.gcount() == 0;
+}
+
+bool TrigramIndex::compact() {
+    if (log.is_open()) {
+        log.close();
+    }
+    
+    string tempPath = logPath + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out.is_open()) return false;
+        
+        out.write(LOG_MAGIC, sizeof(LOG_MAGIC));
+        logSize = sizeof(LOG_MAGIC);
+        for (const FileEntry& entry : files) {
+            if (!entry.live) continue;
+            string record = encodeRecord(entry);
+            uint32_t length = record.length();
+            out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.write(record.data(), length);
+            logSize += sizeof(length) + length;
+        }
+        out.flush();
+        if (!out) {
+            out.close();
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    bool renamed = MoveFileExA(tempPath.c_str(), logPath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = rename(tempPath.c_str(), logPath.c_str()) == 0;
+#endif
+    if (!renamed) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    log.open(logPath, ios::binary | ios::app);
+    return log.is_open();
+}
+
+bool TrigramIndex::open() {
+    if (log.is_open()) {
+        log.close();
+    }
+    files.clear();
+    fileIds.clear();
+    postings.clear();
+    liveFiles = 0;
+    liveBytes = 0;
+    logSize = 0;
+    
+    // Records replayed before a damaged one are kept; refresh() re-indexes
+    // whatever they got wrong and the log is rewritten
+    bool clean = loadLog();
+    if (clean) {
+        log.open(logPath, ios::binary | ios::app);
+    }
+    refresh();
+    
+    if (!clean || !log.is_open() || logSize > 2 * liveBytes + COMPACT_SLACK) {
+        return compact();
+    }
+    return true;
+}
+
+size_t TrigramIndex::refresh() {
+    size_t changed = 0;
+    set<string> present;
+    
+    for (const string& name : listDirectory(directory)) {
+        if (!isIndexable(name)) continue;
+        
+        uint64_t size;
+        int64_t modified;
+        string path = directory + "/" + name;
+        if (!statFile(path, size, modified)) continue;
+        present.insert(name);
+        
+        auto found = fileIds.find(name);
+        if (found != fileIds.end()) {
+            const FileEntry& entry = files[found->second];
+            if (entry.live && entry.size == size && entry.modified == modified) continue;
+        }
+        if (updateFile(path)) {
+            changed++;
+        }
+    }
+    
+    vector<string> removed;
+    for (const auto& file : fileIds) {
+        if (files[file.second].live && present.find(file.first) == present.end()) {
+            removed.push_back(file.first);
+        }
+    }
+    for (const string& name : removed) {
+        removeFile(directory + "/" + name);
+        changed++;
+    }
+    return changed;
+}
+
+bool TrigramIndex::updateFile(const string& path, const BufferView& text) {
+    string name = relativeName(path);
+    FileEntry entry;
+    if (name.empty() || !statFile(path, entry.size, entry.modified)) {
+        return false;
+    }
+    
+    entry.name = name;
+    entry.live = true;
+    indexText(entry, text);
+    
+    string record = encodeRecord(entry);
+    entry.recordBytes = sizeof(uint32_t) + record.length();
+    appendRecord(record);
+    setEntry(getFileId(name), entry);
+    
+    // Mostly superseded records: rewrite the log with the live ones
+    if (log.is_open() && logSize > 2 * liveBytes + COMPACT_SLACK) {
+        compact();
+    }
+    return true;
+}
+
+bool TrigramIndex::updateFile(const string& path) {
+    uint64_t size;
+    int64_t modified;
+    if (relativeName(path).empty() || !statFile(path, size, modified)) {
+        return false;
+    }
+    if (size > MAX_INDEXED_SIZE) {
+        return updateFile(path, BufferView());  // recorded as unindexed
+    }
+    
+    MappedFile mapped;
+    if (mapped.open(path)) {
+        vector<TextSpan> spans(1, TextSpan(mapped.getData(), mapped.getSize()));
+        return updateFile(path, BufferView(spans));
+    }
+    
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) return false;
+    stringstream ss;
+    ss << file.rdbuf();
+    string text = ss.str();
+    return updateFile(path, BufferView(text));
+}
+
+void TrigramIndex::removeFile(const string& path) {
+    auto found = fileIds.find(relativeName(path));
+    if (found == fileIds.end() || !files[found->second].live) return;
+    
+    FileEntry entry;
+    entry.name = found->first;
+    appendRecord(encodeRecord(entry));
+    setEntry(found->second, entry);
+}
+
+vector<string> TrigramIndex::candidateFiles(const string& pattern) const {
+    vector<string> paths;
+    
+    vector<uint32_t> candidates;
+    if (pattern.length() < 3) {
+        for (uint32_t id = 0; id < files.size(); id++) {
+            if (files[id].live) candidates.push_back(id);
+        }
+    } else {
+        // Distinct trigrams of the pattern, each with one offset
+        vector<pair<uint32_t, size_t>> patternTrigrams;
+        set<uint32_t> seen;
+        uint32_t window = 0;
+        for (size_t i = 0; i < pattern.length(); i++) {
+            window = ((window << 8) | foldByte(pattern[i])) & 0xFFFFFF;
+            if (i >= 2 && seen.insert(window).second) {
+                patternTrigrams.push_back(make_pair(window, i - 2));
+            }
+        }
+        
+        // Intersect the posting lists, shortest first
+        vector<const vector<uint32_t>*> lists;
+        bool missing = false;
+        for (const auto& trigram : patternTrigrams) {
+            auto found = postings.find(trigram.first);
+            if (found == postings.end()) {
+                missing = true;
+                break;
+            }
+            lists.push_back(&found->second);
+        }
+        if (!missing) {
+            sort(lists.begin(), lists.end(),
+                 [](const vector<uint32_t>* a, const vector<uint32_t>* b) { return a->size() < b->size(); });
+            candidates = *lists[0];
+            for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+                vector<uint32_t> both;
+                set_intersection(candidates.begin(), candidates.end(),
+                                 lists[i]->begin(), lists[i]->end(), back_inserter(both));
+                candidates.swap(both);
+            }
+            
+            vector<uint32_t> aligned;
+            for (uint32_t id : candidates) {
+                if (mayContain(files[id], patternTrigrams)) aligned.push_back(id);
+            }
+            candidates.swap(aligned);
+        }
+        
+        // Unindexed files cannot be ruled out
+        for (uint32_t id = 0; id < files.size(); id++) {
+            if (files[id].live && !files[id].indexed) candidates.push_back(id);
+        }
+    }
+    
+    for (uint32_t id : candidates) {
+        paths.push_back(directory + "/" + files[id].name);
+    }
+    sort(paths.begin(), paths.end());
+    return paths;
+}
@@ -0,0 +1,90 @@
+#include "UndoSpill.h"
+#include <cstdio>
+#include <ctime>
+
+using namespace std;
+
+// ==================== UndoSpillFile Implementation ====================
+
+UndoSpillFile::UndoSpillFile() : endOffset(0) {
+    static int spillCounter = 0;
+    
+    ensureDataFolderExists();
+    path = "data/undo_spill_" + to_string(time(nullptr)) + "_" +
+           to_string(reinterpret_cast<size_t>(this) % 100000) + "_" +
+           to_string(spillCounter++) + ".tmp";
+    file.open(path, ios::in | ios::out | ios::binary | ios::trunc);
+}
+
+UndoSpillFile::~UndoSpillFile() {
+    if (file.is_open()) {
+        file.close();
+    }
+    remove(path.c_str());
+}
+
+bool UndoSpillFile::append(const string& record, size_t& offset) {
+    if (!file.is_open()) return false;
+    
+    file.clear();
+    file.seekp(endOffset);
+    file.write(record.data(), record.length());
+    if (!file) return false;
+    
+    offset = endOffset;
+    endOffset += record.length();
+    return true;
+}
+
+bool UndoSpillFile::read(size_t offset, size_t length, string& record) {
+    if (!file.is_open() || offset + length > endOffset) return false;
+    
+    file.clear();
+    file.flush();
+    file.seekg(offset);
+    record.resize(length);
+    if (length > 0) {
+        file.read(&record[0], length);
+    }
+    return static_cast<bool>(file);
+}
+
+// ==================== SpilledCommand Implementation ====================
+
+SpilledCommand::SpilledCommand(TextBuffer* buf, shared_ptr<UndoSpillFile> file, size_t off, size_t len)
+    : buffer(buf), spillFile(move(file)), offset(off), length(len) {}
+
+bool SpilledCommand::prepare() {
+    if (loaded) return true;
+    
+    string record;
+    if (!spillFile->read(offset, length, record)) return false;
+    loaded = Command::deserialize(buffer, record);
+    return loaded != nullptr;
+}
+
+void SpilledCommand::execute() {
+    if (prepare()) {
+        loaded->execute();
+        loaded.reset();  // the record stays in the file
+    }
+}
+
+void SpilledCommand::undo() {
+    if (prepare()) {
+        loaded->undo();
+        loaded.reset();
+    }
+}
+
+string SpilledCommand::getDescription() const {
+    return loaded ? loaded->getDescription() : "Spilled command (" + to_string(length) + " bytes on disk)";
+}
+
+size_t SpilledCommand::memoryUsage() const {
+    return sizeof(*this) + (loaded ? loaded->memoryUsage() : 0);
+}
+
+string SpilledCommand::serialize() const {
+    return "";  // already on disk
+}
@@ -23,8 +23,8 @@ void ensureDataFolderForVersions() {
 
 // ==================== VersionSnapshot Implementation ====================
 
-VersionSnapshot::VersionSnapshot(int versionId, const string& text, const string& desc, const string& file)
-    : id(versionId), content(text), description(desc), filename(file) {
+VersionSnapshot::VersionSnapshot(int versionId, string text, const string& desc, const string& file)
+    : id(versionId), content(move(text)), description(desc), filename(file) {
     time_t now = time(nullptr);
     char buffer[80];
     strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime(&now));
@@ -61,7 +61,7 @@ shared_ptr<VersionSnapshot> VersionSnapshot::deserialize(const string& data) {
     content.resize(contentLength);
     ss.read(&content[0], contentLength);
     
-    auto snapshot = make_shared<VersionSnapshot>(id, content, description, filename);
+    auto snapshot = make_shared<VersionSnapshot>(id, move(content), description, filename);
     return snapshot;
 }
 
@@ -95,7 +95,8 @@ int VersionManager::createSnapshot(TextEditor& editor, const string& description
         filename = "(Untitled)";
     }
     
-    auto snapshot = make_shared<VersionSnapshot>(nextId++, content, description, filename);
+    // The snapshot takes over the editor's copy instead of making a second one
+    auto snapshot = make_shared<VersionSnapshot>(nextId++, move(content), description, filename);
     
     SnapshotNode* node = new SnapshotNode(snapshot);
     
@@ -17,6 +17,7 @@ VersionHistory versionHistory;
 AdvancedSearchEngine searchEngine;
 SearchHistory searchHistory;
 VersionManager versionManager;
+shared_ptr<TrigramIndex> fileIndex = make_shared<TrigramIndex>("data");
 
 // Color codes for Windows console
 enum Color {
@@ -102,10 +103,13 @@ void handleUndo();
 void handleRedo();
 void handleSearch();
 void handleAdvancedSearch();
+void handleSearchInFiles();
 void handleSearchAndReplace();
 void handleLoadFile();
 void handleSaveFile();
 void handleVersionManagement();
+void handleGotoLine();
+void handleUndoHistory();
 
 // ============================================================================
 // VERSION MANAGEMENT
@@ -394,6 +398,8 @@ void handleUndo() {
         setColor(YELLOW);
         cout << editor.getText() << endl;
         setColor(GRAY);
+    } else if (editor.canUndo()) {
+        printError("Could not read the undo step back from disk!");
     } else {
         printError("Nothing to undo!");
     }
@@ -416,6 +422,8 @@ void handleRedo() {
         setColor(YELLOW);
         cout << editor.getText() << endl;
         setColor(GRAY);
+    } else if (editor.canRedo()) {
+        printError("Could not read the redo step back from disk!");
     } else {
         printError("Nothing to redo!");
     }
@@ -428,12 +436,83 @@ void handleRedo() {
     _getch();
 }
 
+void handleUndoHistory() {
+    printHeader("UNDO HISTORY");
+    
+    const UndoTree& history = editor.getHistory();
+    setColor(CYAN);
+    cout << "States: ";
+    setColor(YELLOW);
+    cout << history.size();
+    setColor(CYAN);
+    cout << "   Current: ";
+    setColor(YELLOW);
+    cout << editor.getCurrentState() << endl;
+    
+    // The most recent states, newest first
+    setColor(GRAY);
+    size_t shown = 0;
+    for (size_t id = history.size() - 1; id > 0 && shown < 10; id--, shown++) {
+        cout << "  " << (id == editor.getCurrentState() ? "> " : "  ")
+             << setw(4) << id << " | parent " << setw(4) << history.getNode(id).parent
+             << " | " << history.getNode(id).command->getDescription() << endl;
+    }
+    
+    setColor(YELLOW);
+    cout << "\n  [1] Jump to State ID" << endl;
+    cout << "  [2] Jump Back N Seconds" << endl;
+    setColor(RED);
+    cout << "  [0] Back to Main Menu" << endl;
+    setColor(WHITE);
+    cout << "\nEnter your choice: ";
+    setColor(GRAY);
+    
+    int choice;
+    cin >> choice;
+    
+    bool jumped = false;
+    bool known = false;  // the target exists, so a failed jump hit an unreadable step
+    if (choice == 1) {
+        cout << "State ID: ";
+        size_t state;
+        cin >> state;
+        known = state < history.size();
+        jumped = editor.jumpToState(state);
+    } else if (choice == 2) {
+        cout << "Seconds: ";
+        long long seconds;
+        cin >> seconds;
+        known = true;
+        jumped = editor.jumpToTime(chrono::system_clock::now() - chrono::seconds(seconds));
+    }
+    cin.ignore();
+    
+    if (jumped) {
+        printSuccess("Now at state " + to_string(editor.getCurrentState()));
+        setColor(YELLOW);
+        cout << editor.getText() << endl;
+        setColor(GRAY);
+    } else if (known) {
+        printError("Stopped at state " + to_string(editor.getCurrentState()) +
+                   ": an undo step could not be read back from disk!");
+    } else if (choice != 0) {
+        printError("No such state!");
+    }
+    
+    cout << "\n";
+    printSeparator('-', 70);
+    setColor(WHITE);
+    cout << "Press any key to continue...";
+    setColor(GRAY);
+    _getch();
+}
+
 // ============================================================================
 // SEARCH OPERATIONS
 // ============================================================================
 
 void handleSearch() {
-    printHeader("SEARCH TEXT (Rolling Hash)");
+    printHeader("SEARCH TEXT");
     
     setColor(CYAN);
     cout << "Current text:\n";
@@ -447,7 +526,7 @@ void handleSearch() {
     string pattern;
     getline(cin, pattern);
     
-    vector<size_t> results = editor.search(pattern);
+    vector<size_t> results = searchEngine.findAll(editor.getBuffer(), pattern);
     
     cout << "\n";
     printSeparator('-', 70);
@@ -481,7 +560,7 @@ void handleSearch() {
 }
 
 void handleAdvancedSearch() {
-    printHeader("ADVANCED SEARCH (KMP)");
+    printHeader("ADVANCED SEARCH");
     
     setColor(CYAN);
     cout << "Current text:\n";
@@ -510,13 +589,44 @@ void handleAdvancedSearch() {
     cin >> choice;
     options.wholeWord = (choice == 'y' || choice == 'Y');
     
+    setColor(WHITE);
+    cout << "Regular expression? (y/n): ";
+    setColor(GRAY);
+    cin >> choice;
+    options.useRegex = (choice == 'y' || choice == 'Y');
+    
+    setColor(WHITE);
+    cout << "Search backward (last match first)? (y/n): ";
+    setColor(GRAY);
+    cin >> choice;
+    options.searchBackward = (choice == 'y' || choice == 'Y');
+    
     setColor(WHITE);
     cout << "Context lines (0-5): ";
     setColor(GRAY);
     cin >> options.contextLines;
+    
+    setColor(WHITE);
+    cout << "Maximum results (0 = no limit): ";
+    setColor(GRAY);
+    cin >> options.maxResults;
     cin.ignore();
     
-    vector<SearchResult> results = searchEngine.search(editor.getText(), pattern, options);
+    string regexError;
+    if (options.useRegex && !searchEngine.isValidRegex(pattern, &regexError)) {
+        printError("Invalid regular expression: " + regexError);
+        setColor(WHITE);
+        cout << "Press any key to continue...";
+        setColor(GRAY);
+        _getch();
+        return;
+    }
+    
+    // Results are found a page at a time, so a pattern with millions of
+    // matches costs no more than the pages actually shown
+    const size_t PAGE_SIZE = 20;
+    SearchCursor cursor = searchEngine.openSearch(editor.getBuffer(), pattern, options);
+    vector<SearchResult> page = cursor.nextPage(PAGE_SIZE);
     
     cout << "\n";
     printSeparator('=', 70);
@@ -524,25 +634,47 @@ void handleAdvancedSearch() {
     cout << "SEARCH RESULTS" << endl;
     printSeparator('=', 70);
     
-    if (results.empty()) {
+    if (page.empty()) {
         printError("No matches found!");
-    } else {
-        printSuccess("Found " + to_string(results.size()) + " occurrence(s)");
-        
-        for (const auto& result : results) {
+    }
+    
+    size_t shown = 0;
+    while (!page.empty()) {
+        for (const auto& result : page) {
             cout << "\n";
             printSeparator('-', 70);
             setColor(YELLOW);
             cout << "Match at position " << result.position 
-                 << " (Line " << result.line << ", Col " << result.column << ")" << endl;
+                 << " (Line " << result.line << ", Col " << result.column
+                 << ", Length " << result.length << ")" << endl;
             setColor(CYAN);
             cout << "Context:" << endl;
             setColor(GRAY);
-            cout << result.context << endl;
+            cout << cursor.getContext(result) << endl;
+        }
+        shown += page.size();
+        
+        page = cursor.nextPage(PAGE_SIZE);
+        if (page.empty()) break;
+        
+        setColor(WHITE);
+        cout << "\nShow more results? (y/n): ";
+        setColor(GRAY);
+        cin >> choice;
+        cin.ignore();
+        if (choice != 'y' && choice != 'Y') {
+            setColor(DARK_GRAY);
+            cout << "(more results not shown)" << endl;
+            setColor(GRAY);
+            break;
         }
     }
     
-    searchHistory.addSearch(pattern, results.size());
+    if (shown > 0) {
+        printSuccess("Showed " + to_string(shown) + " occurrence(s)");
+    }
+    
+    searchHistory.addSearch(pattern, shown);
     
     cout << "\n";
     printSeparator('=', 70);
@@ -552,6 +684,113 @@ void handleAdvancedSearch() {
     _getch();
 }
 
+void handleSearchInFiles() {
+    printHeader("SEARCH IN FILES");
+    
+    setColor(CYAN);
+    cout << "Searching every file in the 'data' folder (" << fileIndex->getFileCount()
+         << " indexed)" << endl;
+    printSeparator('-', 70);
+    setColor(GRAY);
+    
+    setColor(WHITE);
+    cout << "\nEnter pattern to search: ";
+    setColor(GRAY);
+    string pattern;
+    getline(cin, pattern);
+    
+    SearchOptions options;
+    
+    setColor(WHITE);
+    cout << "\nCase sensitive? (y/n): ";
+    setColor(GRAY);
+    char choice;
+    cin >> choice;
+    options.caseSensitive = (choice == 'y' || choice == 'Y');
+    
+    setColor(WHITE);
+    cout << "Whole word only? (y/n): ";
+    setColor(GRAY);
+    cin >> choice;
+    cin.ignore();
+    options.wholeWord = (choice == 'y' || choice == 'Y');
+    
+    // Pick up files changed outside the editor since the last search
+    fileIndex->refresh();
+    vector<FileSearchResult> files = searchEngine.searchFiles(*fileIndex, pattern, options);
+    
+    cout << "\n";
+    printSeparator('=', 70);
+    
+    if (files.empty()) {
+        printError("No file contains the pattern!");
+    } else {
+        printSuccess("Found in " + to_string(files.size()) + " file(s)");
+        
+        for (const auto& file : files) {
+            cout << "\n";
+            setColor(YELLOW);
+            cout << file.path;
+            setColor(GRAY);
+            cout << " - " << file.results.size() << " occurrence(s)" << endl;
+            
+            const SearchResult& first = file.results.front();
+            setColor(DARK_GRAY);
+            cout << "  First match: Line " << first.line << ", Col " << first.column << endl;
+            setColor(GRAY);
+            cout << first.context << endl;
+        }
+    }
+    
+    searchHistory.addSearch(pattern, files.size());
+    
+    cout << "\n";
+    printSeparator('=', 70);
+    setColor(WHITE);
+    cout << "Press any key to continue...";
+    setColor(GRAY);
+    _getch();
+}
+
+void handleGotoLine() {
+    printHeader("GO TO LINE");
+    
+    size_t lineCount = editor.getLineCount();
+    setColor(CYAN);
+    cout << "Lines: ";
+    setColor(YELLOW);
+    cout << lineCount << endl;
+    
+    setColor(WHITE);
+    cout << "\nEnter line number: ";
+    setColor(GRAY);
+    size_t line;
+    cin >> line;
+    cin.ignore();
+    
+    if (line < 1 || line > lineCount) {
+        printError("Line out of range!");
+    } else {
+        size_t start = editor.gotoLine(line);
+        size_t end = (line < lineCount) ? editor.gotoLine(line + 1) : editor.getLength();
+        
+        setColor(CYAN);
+        cout << "\nLine " << line << " starts at position ";
+        setColor(YELLOW);
+        cout << start << endl;
+        setColor(GRAY);
+        printSeparator('-', 70);
+        cout << editor.getBuffer().getSubstring(start, end - start) << endl;
+        printSeparator('-', 70);
+    }
+    
+    cout << "\n";
+    setColor(WHITE);
+    cout << "Press any key to continue...";
+    setColor(GRAY);
+    _getch();
+}
+
 void handleSearchAndReplace() {
     printHeader("SEARCH AND REPLACE");
     
@@ -751,9 +990,10 @@ void displayMenu() {
     setColor(MAGENTA);
     cout << "  SEARCH OPERATIONS:" << endl;
     setColor(GRAY);
-    cout << "    [6]  Basic Search (Rolling Hash)" << endl;
-    cout << "    [7]  Advanced Search (KMP/Boyer-Moore)" << endl;
+    cout << "    [6]  Basic Search (SIMD Scan/Suffix Array)" << endl;
+    cout << "    [7]  Advanced Search (Options/Regex)" << endl;
     cout << "    [8]  Search and Replace" << endl;
+    cout << "    [15] Search in Files (data folder)" << endl;
     
     cout << "\n";
     setColor(BLUE);
@@ -774,6 +1014,8 @@ void displayMenu() {
     cout << "  OTHER:" << endl;
     setColor(GRAY);
     cout << "    [12] Display Current Text" << endl;
+    cout << "    [13] Go to Line" << endl;
+    cout << "    [14] Undo History (Branches)" << endl;
     setColor(RED);
     cout << "    [0]  Exit" << endl;
     setColor(GRAY);
@@ -795,6 +1037,14 @@ void displayMenu() {
     setColor(editor.canRedo() ? GREEN : RED);
     cout << (editor.canRedo() ? "Yes" : "No") << endl;
     setColor(GRAY);
+    cout << "    Undo Memory: ";
+    setColor(YELLOW);
+    cout << editor.getUndoMemoryUsage() << " bytes";
+    if (editor.getUndoSpillSize() > 0) {
+        cout << " (+" << editor.getUndoSpillSize() << " on disk)";
+    }
+    cout << endl;
+    setColor(GRAY);
     cout << "    Saved Versions: ";
     setColor(YELLOW);
     cout << versionManager.getVersionCount() << endl;
@@ -819,7 +1069,7 @@ int main() {
     cout << "\n  Features:" << endl;
     setColor(GRAY);
     cout << "    - Undo/Redo with Command Pattern" << endl;
-    cout << "    - Advanced Search (Rolling Hash, KMP, Boyer-Moore)" << endl;
+    cout << "    - Advanced Search (SIMD Scan, Suffix Array, Regex)" << endl;
     cout << "    - Version Management System" << endl;
     cout << "    - File Operations (data folder)" << endl;
     cout << "    - Search History" << endl;
@@ -831,6 +1081,13 @@ int main() {
     setColor(GRAY);
     _getch();
     
+    // Keep at most 64 MB of undo history in memory; older edits go to data/
+    editor.setUndoMemoryBudget(64 * 1024 * 1024);
+    
+    // Index data/ once; saves keep it current from then on
+    fileIndex->open();
+    editor.setFileIndex(fileIndex);
+    
     int choice;
     
     do {
@@ -895,6 +1152,15 @@ int main() {
                 _getch();
                 break;
             }
+            case 13:
+                handleGotoLine();
+                break;
+            case 14:
+                handleUndoHistory();
+                break;
+            case 15:
+                handleSearchInFiles();
+                break;
             case 0:
                 system("cls");
                 setColor(CYAN);
@@ -37,7 +37,7 @@ echo ""
 # ============================================================================
 
 echo -e "${BLUE}=== COMPILING TEST 1: Buffer Tests ===${NC}"
-g++ -o test_buffer test_buffer.cpp ../src/Buffer.cpp -std=c++11 -I../src
+g++ -o test_buffer test_buffer.cpp ../src/Buffer.cpp ../src/PieceTable.cpp ../src/Rope.cpp ../src/MappedFile.cpp ../src/UndoSpill.cpp ../src/SimdScan.cpp ../src/TrigramIndex.cpp -std=c++11 -I../src
 
 if [ $? -eq 0 ]; then
     echo -e "${GREEN}✓ Compilation successful${NC}"
@@ -68,7 +68,7 @@ echo ""
 # ============================================================================
 
 echo -e "${BLUE}=== COMPILING TEST 2: Search Tests ===${NC}"
-g++ -o test_search test_search.cpp ../src/AdvancedSearch.cpp ../src/Buffer.cpp -std=c++11 -I../src
+g++ -o test_search test_search.cpp ../src/AdvancedSearch.cpp ../src/RegexEngine.cpp ../src/SuffixArray.cpp ../src/ThreadPool.cpp ../src/Buffer.cpp ../src/PieceTable.cpp ../src/Rope.cpp ../src/MappedFile.cpp ../src/UndoSpill.cpp ../src/SimdScan.cpp ../src/TrigramIndex.cpp -std=c++11 -pthread -I../src
 
 if [ $? -eq 0 ]; then
     echo -e "${GREEN}✓ Compilation successful${NC}"
@@ -99,7 +99,7 @@ echo ""
 # ============================================================================
 
 echo -e "${BLUE}=== COMPILING TEST 3: History Tests ===${NC}"
-g++ -o test_history test_history.cpp ../src/History.cpp ../src/Buffer.cpp -std=c++11 -I../src
+g++ -o test_history test_history.cpp ../src/History.cpp ../src/Buffer.cpp ../src/PieceTable.cpp ../src/Rope.cpp ../src/MappedFile.cpp ../src/UndoSpill.cpp ../src/SimdScan.cpp ../src/TrigramIndex.cpp -std=c++11 -I../src
 
 if [ $? -eq 0 ]; then
     echo -e "${GREEN}✓ Compilation successful${NC}"
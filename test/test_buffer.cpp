@@ -1,11 +1,15 @@
 // test_buffer.cpp - Unit tests for TextBuffer and TextEditor
-// Compile: g++ -o test_buffer test_buffer.cpp ../src/Buffer.cpp -std=c++11 -I../src
+// Compile: g++ -o test_buffer test_buffer.cpp ../src/Buffer.cpp ../src/PieceTable.cpp ../src/Rope.cpp ../src/MappedFile.cpp ../src/UndoSpill.cpp ../src/SimdScan.cpp ../src/TrigramIndex.cpp -std=c++11 -I../src
 // Run: ./test_buffer
 
 #include "../src/Buffer.h"
+#include "../src/SimdScan.h"
+#include "../src/UndoSpill.h"
 #include <iostream>
 #include <cassert>
 #include <string>
+#include <fstream>
+#include <chrono>
 
 using namespace std;
 
@@ -135,6 +139,134 @@ void test_buffer_chunk_rebalancing() {
     test_result("TextBuffer - Chunk rebalancing", passed);
 }
 
+void test_buffer_local_rebalancing() {
+    TextBuffer buffer(string(5000, 'A'));
+    string expected(5000, 'A');
+    
+    // Scattered small edits split and merge chunks around the edit point only
+    for (int i = 0; i < 200; i++) {
+        size_t pos = (i * 37) % expected.length();
+        buffer.insert(pos, "xyz");
+        expected.insert(pos, "xyz");
+        buffer.deleteText((i * 91) % expected.length(), 5);
+        expected.erase((i * 91) % expected.length(), 5);
+    }
+    
+    // Large delete spanning many chunks
+    buffer.deleteText(100, 3000);
+    expected.erase(100, 3000);
+    
+    bool passed = (buffer.getText() == expected && buffer.length() == expected.length());
+    test_result("TextBuffer - Local split/merge keeps content intact", passed);
+}
+
+void test_buffer_indexed_lookup() {
+    string expected;
+    for (int i = 0; i < 2000; i++) {
+        expected += to_string(i) + ",";
+    }
+    TextBuffer buffer(expected);
+    
+    // Grow and shrink chunks so they are split and merged under the index
+    buffer.insert(10, string(600, '#'));
+    expected.insert(10, string(600, '#'));
+    buffer.deleteText(3000, 700);
+    expected.erase(3000, 700);
+    
+    bool passed = true;
+    for (size_t pos = 0; pos < expected.length(); pos += 97) {
+        if (buffer.getSubstring(pos, 7) != expected.substr(pos, 7)) {
+            passed = false;
+        }
+    }
+    test_result("TextBuffer - Position lookup after split/merge", passed);
+}
+
+void test_buffer_view_iteration() {
+    string expected;
+    for (int i = 0; i < 300; i++) {
+        expected += "line " + to_string(i) + "\n";
+    }
+    TextBuffer buffer(expected);
+    buffer.insert(700, "<inserted>");
+    expected.insert(700, "<inserted>");
+    
+    BufferView view = buffer.getView();
+    string walked(view.begin(), view.end());
+    
+    bool passed = (view.getSpanCount() > 1 &&
+                   walked == expected &&
+                   view[1500] == expected[1500] &&
+                   *(view.begin() + 2000) == expected[2000] &&
+                   view.substr(695, 20) == expected.substr(695, 20));
+    test_result("BufferView - Iterate across chunk boundaries", passed);
+}
+
+void test_buffer_line_index() {
+    string text;
+    for (int i = 0; i < 500; i++) {
+        text += "row " + to_string(i) + "\n";
+    }
+    
+    bool passed = true;
+    BufferBackend backends[] = {BufferBackend::Chunked, BufferBackend::PieceTable, BufferBackend::Rope};
+    for (BufferBackend backend : backends) {
+        TextBuffer buffer(text, backend);
+        buffer.insert(buffer.getLineStart(100), "new\nlines\n");  // two lines before row 99
+        buffer.deleteText(buffer.getLineStart(3), 6);             // drops "row 2\n"
+        
+        size_t line, col;
+        buffer.getLineAndColumn(buffer.getText().find("row 250"), line, col);
+        
+        passed = passed &&
+                 buffer.getLineCount() == 501 + 2 - 1 &&
+                 buffer.getSubstring(buffer.getLineStart(99), 3) == "new" &&
+                 buffer.getSubstring(buffer.getLineStart(3), 6) == "row 3\n" &&
+                 line == 252 && col == 1 &&
+                 buffer.getLineStart(10000) == buffer.length();
+    }
+    test_result("TextBuffer - Line index after edits", passed);
+}
+
+void test_buffer_line_index_interleaved() {
+    string expected;
+    for (int i = 0; i < 300; i++) {
+        expected += "line " + to_string(i) + "\n";
+    }
+    
+    bool passed = true;
+    BufferBackend backends[] = {BufferBackend::Chunked, BufferBackend::PieceTable, BufferBackend::Rope};
+    for (BufferBackend backend : backends) {
+        TextBuffer buffer(expected, backend);
+        string text = expected;
+        
+        // Every edit splits or merges pieces; the index must follow each one
+        for (int i = 0; i < 400 && passed; i++) {
+            size_t pos = (i * 7919) % (text.length() + 1);
+            if (i % 3 == 2) {
+                buffer.deleteText(pos, 40);
+                text.erase(pos, 40);
+            } else {
+                string insertion = (i % 2) ? "ab\ncd" : string(300, 'x');
+                buffer.insert(pos, insertion);
+                text.insert(pos, insertion);
+            }
+            
+            size_t lines = count(text.begin(), text.end(), '\n') + 1;
+            size_t line = 1 + (i * 31) % lines;
+            size_t lineStart = 0;
+            for (size_t k = 1; k < line; k++) {
+                lineStart = text.find('\n', lineStart) + 1;
+            }
+            passed = buffer.getLineCount() == lines &&
+                     buffer.getLineStart(line) == lineStart &&
+                     buffer.getSubstring(pos, 16) == text.substr(pos, 16);
+        }
+        passed = passed && buffer.getText() == text;
+    }
+    test_result("TextBuffer - Line index between every edit", passed);
+}
+
 // ============================================================================
 // TEST SUITE 3: TextEditor with Commands (Undo/Redo)
 // ============================================================================
@@ -219,6 +351,252 @@ void test_editor_undo_clears_redo() {
     test_result("TextEditor - New operation clears redo stack", passed);
 }
 
+void test_editor_coalesce_typing() {
+    TextEditor editor;
+    editor.setCoalescing(60000, 64);
+    
+    string typed = "The quick brown fox jumps over the lazy dog";
+    for (size_t i = 0; i < typed.length(); i++) {
+        editor.insert(i, string(1, typed[i]));
+    }
+    bool typing_ok = (editor.getUndoCount() == 1 && editor.getText() == typed);
+    
+    // Backspace five times, then forward-delete twice at the same spot
+    size_t cursor = typed.length();
+    for (int i = 0; i < 5; i++) {
+        editor.deleteText(--cursor, 1);
+    }
+    editor.deleteText(0, 1);  // not contiguous with the backspace run
+    editor.deleteText(0, 1);
+    bool delete_ok = (editor.getUndoCount() == 3 && editor.getText() == "e quick brown fox jumps over the laz");
+    
+    editor.undo();
+    editor.undo();
+    bool undo_ok = (editor.getText() == typed);
+    
+    // The size window splits long runs
+    TextEditor limited;
+    limited.setCoalescing(60000, 10);
+    for (int i = 0; i < 25; i++) {
+        limited.insert(i, "x");
+    }
+    
+    bool passed = (typing_ok && delete_ok && undo_ok && limited.getUndoCount() == 3);
+    test_result("TextEditor - Coalesce keystroke inserts and deletes", passed);
+}
+
+void test_editor_undo_spill() {
+    TextEditor editor;
+    string chunk(2000, 'r');
+    for (int i = 0; i < 50; i++) {
+        editor.replace(0, editor.getLength(), chunk + to_string(i));
+    }
+    size_t unbounded = editor.getUndoMemoryUsage();
+    
+    editor.setUndoMemoryBudget(16 * 1024);
+    bool spilled = (editor.getUndoMemoryUsage() <= 16 * 1024 &&
+                    editor.getUndoSpillSize() > 0 &&
+                    unbounded > 100 * 1024);
+    
+    // Undo all the way back, paging spilled commands in from disk
+    int undone = 0;
+    while (editor.undo()) undone++;
+    bool undo_ok = (undone == 50 && editor.getText() == "");
+    
+    while (editor.redo()) {}
+    bool redo_ok = (editor.getText() == chunk + "49" &&
+                    editor.getUndoMemoryUsage() <= 16 * 1024);
+    
+    // A record that cannot be read back refuses the step
+    TextBuffer scratch("abc");
+    SpilledCommand unreadable(&scratch, make_shared<UndoSpillFile>(), 0, 64);  // nothing written
+    bool refused = (!unreadable.prepare() && scratch.getText() == "abc");
+    
+    // Corrupt records are rejected rather than throwing or over-allocating
+    const char* corrupt[] = {"I|1x|1|a", "I|99999999999999999999999|1|a", "D|-1|1|a",
+                             "I|0|999999999999|a", "A|999999999999999|1|a1|b", "M|4000000000|"};
+    for (const char* record : corrupt) {
+        refused = refused && Command::deserialize(&scratch, record) == nullptr;
+    }
+    refused = refused && Command::deserialize(&scratch, "A|2|1|a1|b0|2|") != nullptr;
+    
+    bool passed = (spilled && undo_ok && redo_ok && refused);
+    test_result("TextEditor - Undo history spills to disk over budget", passed);
+}
+
+void test_editor_undo_tree_branches() {
+    TextEditor editor;
+    editor.insert(0, "Hello");
+    editor.insert(5, " World");
+    size_t worldState = editor.getCurrentState();
+    auto beforeBranch = chrono::system_clock::now();
+    
+    // Undo, then edit: the " World" branch is kept
+    editor.undo();
+    editor.insert(5, " There");
+    size_t thereState = editor.getCurrentState();
+    bool branched = (editor.getText() == "Hello There" && !editor.canRedo());
+    
+    editor.jumpToState(worldState);
+    bool jump_ok = (editor.getText() == "Hello World" && editor.getUndoCount() == 2);
+    
+    editor.undo();
+    editor.redo();  // follows the branch visited last
+    bool redo_ok = (editor.getText() == "Hello World");
+    
+    editor.jumpToTime(beforeBranch);
+    bool time_ok = (editor.getText() == "Hello World");
+    
+    editor.jumpToState(0);
+    bool root_ok = (editor.getText() == "" && !editor.canUndo());
+    editor.jumpToState(thereState);
+    
+    bool passed = (branched && jump_ok && redo_ok && time_ok && root_ok &&
+                   editor.getText() == "Hello There" && editor.getHistory().size() == 4);
+    test_result("TextEditor - Undo tree keeps branches", passed);
+}
+
+void test_editor_transaction() {
+    TextEditor editor;
+    string original;
+    for (int i = 0; i < 200; i++) {
+        original += "item " + to_string(i) + ";\n";
+    }
+    editor.insert(0, original);
+    
+    // 10k scattered edits, checked against a plain string
+    string expected = original;
+    editor.beginTransaction();
+    for (int i = 0; i < 10000; i++) {
+        size_t pos = (i * 7919) % (expected.length() + 1);
+        if (i % 3 == 2 && pos < expected.length()) {
+            editor.deleteText(pos, 2);
+            expected.erase(pos, 2);
+        } else if (i % 3 == 1) {
+            editor.replace(pos, 1, "<>");
+            expected.replace(pos, 1, "<>");
+        } else {
+            editor.insert(pos, "+");
+            expected.insert(pos, "+");
+        }
+    }
+    bool nested = true;
+    {
+        TransactionGuard guard(editor);  // nested: folds into the outer one
+        editor.insert(0, "[");
+        expected.insert(0, "[");
+    }
+    nested = editor.inTransaction();
+    editor.commit();
+    
+    bool applied = (editor.getText() == expected && editor.getUndoCount() == 2);
+    
+    editor.undo();
+    bool undo_ok = (editor.getText() == original);
+    editor.redo();
+    bool redo_ok = (editor.getText() == expected);
+    
+    editor.beginTransaction();
+    editor.deleteText(0, 100);
+    editor.rollback();
+    bool rollback_ok = (editor.getText() == expected && editor.getUndoCount() == 2);
+    
+    bool passed = (nested && applied && undo_ok && redo_ok && rollback_ok);
+    test_result("TextEditor - Transaction records one undo step", passed);
+}
+
+void test_editor_multi_edit() {
+    BufferBackend backends[] = {BufferBackend::Chunked, BufferBackend::PieceTable, BufferBackend::Rope};
+    bool passed = true;
+    
+    for (BufferBackend backend : backends) {
+        TextEditor editor(backend);
+        string original;
+        for (int i = 0; i < 3000; i++) {
+            original += "value = " + to_string(i) + ";\n";
+        }
+        editor.insert(0, original);
+        
+        // Rename every "value" in one step, positions taken up front
+        vector<TextEdit> edits;
+        string expected;
+        size_t last = 0;
+        for (size_t pos = original.find("value"); pos != string::npos; pos = original.find("value", pos + 1)) {
+            edits.push_back(TextEdit(pos, 5, "total"));
+            expected += original.substr(last, pos - last) + "total";
+            last = pos + 5;
+        }
+        expected += original.substr(last);
+        
+        passed = passed && editor.applyEdits(edits);
+        passed = passed && editor.getText() == expected && editor.getUndoCount() == 2;
+        passed = passed && editor.getLineCount() == 3001;
+        
+        editor.undo();
+        passed = passed && editor.getText() == original;
+        editor.redo();
+        passed = passed && editor.getText() == expected;
+        
+        // Overlapping ranges are rejected without touching the text
+        vector<TextEdit> overlapping;
+        overlapping.push_back(TextEdit(10, 5, "x"));
+        overlapping.push_back(TextEdit(12, 1, "y"));
+        passed = passed && !editor.applyEdits(overlapping) && editor.getText() == expected;
+    }
+    
+    test_result("TextEditor - Multi-range edit is one undo step", passed);
+}
+
+void test_editor_replace_all_undo() {
+    TextEditor editor(BufferBackend::PieceTable);
+    string original;
+    for (int i = 0; i < 5000; i++) {
+        original += "aaa foo " + to_string(i) + "\n";
+    }
+    editor.insert(0, original);
+    
+    // "aa" overlaps itself in "aaa": only the first match of each run is replaced
+    int count = editor.searchAndReplace("aa", "b");
+    string expected = original;
+    SearchEngine().searchAndReplace(expected, "aa", "b");
+    bool replaced = (count == 5000 && editor.getText() == expected && editor.getUndoCount() == 2);
+    
+    editor.searchAndReplace("foo", "longer text");
+    editor.undo();
+    bool undo_one = (editor.getText() == expected);
+    editor.undo();
+    bool undo_all = (editor.getText() == original);
+    editor.redo();
+    bool redo_ok = (editor.getText() == expected);
+    
+    bool passed = (replaced && undo_one && undo_all && redo_ok);
+    test_result("TextEditor - Replace all is undoable", passed);
+}
+
+void test_stack_growth_and_reuse() {
+    Stack<shared_ptr<string>> stack;
+    for (int i = 0; i < 1000; i++) {
+        stack.push(make_shared<string>(to_string(i)));
+    }
+    weak_ptr<string> watched = stack.top();
+    bool grown = (stack.getSize() == 1000 && *stack.top() == "999");
+    
+    stack.pop();
+    bool popped = (*stack.top() == "998" && watched.expired());
+    
+    stack.clear();
+    stack.push(make_shared<string>("again"));
+    
+    Stack<int> ints;
+    for (int i = 0; i < 100; i++) ints.push(i);
+    ints.clear();
+    ints.push(7);
+    
+    bool passed = (grown && popped && stack.getSize() == 1 && *stack.top() == "again" &&
+                   ints.getSize() == 1 && ints.top() == 7);
+    test_result("Stack - Growth, pop, clear and reuse", passed);
+}
+
 // ============================================================================
 // TEST SUITE 4: Edge Cases
 // ============================================================================
@@ -315,6 +693,62 @@ void test_search_overlapping_pattern() {
     test_result("SearchEngine::search - Overlapping pattern", passed);
 }
 
+void test_search_simd_levels() {
+    // Long enough to cross many chunks, with matches at every alignment
+    string text;
+    for (int i = 0; i < 40000; i++) {
+        text += (i % 37 == 0) ? "needle" : "hay ";
+    }
+    
+    vector<size_t> expected;
+    for (size_t pos = text.find("needle"); pos != string::npos; pos = text.find("needle", pos + 1)) {
+        expected.push_back(pos);
+    }
+    
+    bool passed = true;
+    SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2};
+    for (SimdLevel level : levels) {
+        vector<size_t> positions;
+        findOccurrences(text.data(), text.length(), "needle", positions, 0, level);
+        passed = passed && (positions == expected);
+    }
+    
+    TextBuffer buffer(text);
+    passed = passed && (SearchEngine().search(buffer.getView(), "needle") == expected);
+    test_result("SearchEngine::search - SIMD levels and chunk boundaries agree", passed);
+}
+
+void test_search_simd_ignore_case() {
+    // Mixed case, and neighbours of the letter ranges ('@', '[', '`', '{')
+    // that a loose fold would confuse with letters
+    string text;
+    for (int i = 0; i < 20000; i++) {
+        text += (i % 29 == 0) ? "A Quick-Brown-Fox-Jumps-Over-The-Lazy-Dog " : "@qu[ck `{ ";
+    }
+    string pattern = "a quick-brown-fox-jumps-over-the-lazy-dog";
+    
+    vector<size_t> expected;
+    for (size_t pos = text.find("A Quick"); pos != string::npos; pos = text.find("A Quick", pos + 1)) {
+        expected.push_back(pos);
+    }
+    
+    bool passed = !expected.empty();
+    SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2};
+    for (SimdLevel level : levels) {
+        vector<size_t> positions;
+        findOccurrencesIgnoreCase(text.data(), text.length(), pattern, positions, 0, level);
+        vector<size_t> brackets;
+        findOccurrencesIgnoreCase(text.data(), text.length(), "{ @QU{", brackets, 0, level);
+        passed = passed && (positions == expected) && brackets.empty();
+    }
+    
+    TextBuffer buffer(text);
+    vector<size_t> fromView;
+    findOccurrencesIgnoreCase(buffer.getView(), "A QUICK", fromView);
+    passed = passed && (fromView == expected);
+    test_result("SearchEngine::search - SIMD case folding", passed);
+}
+
 void test_search_and_replace() {
     SearchEngine engine;
     string text = "Hello World World";
@@ -344,6 +778,128 @@ void test_save_and_load() {
     test_result("File I/O - Save and load", passed);
 }
 
+void test_load_then_edit() {
+    string content;
+    for (int i = 0; i < 5000; i++) {
+        content += "entry " + to_string(i) + "\n";
+    }
+    
+    TextEditor writer;
+    writer.insert(0, content);
+    writer.saveToFile("test_output.txt");
+    
+    // The loaded text may reference the file's pages; edits must still apply
+    TextEditor editor;
+    bool load_ok = editor.loadFromFile("test_output.txt");
+    editor.insert(30000, "[mark]");
+    editor.deleteText(10, 20);
+    content.insert(30000, "[mark]");
+    content.erase(10, 20);
+    
+    bool save_ok = editor.saveToFile();
+    TextEditor reader;
+    reader.loadFromFile("test_output.txt");
+    
+    bool passed = (load_ok && save_ok &&
+                   editor.getText() == content &&
+                   reader.getText() == content);
+    test_result("File I/O - Edit and save over a loaded file", passed);
+}
+
+void test_load_resets_history() {
+    TextEditor writer;
+    writer.insert(0, "other file\n");
+    writer.saveToFile("test_output.txt");
+    
+    TextEditor editor;
+    editor.setUndoMemoryBudget(1024);
+    for (int i = 0; i < 20; i++) {
+        editor.insert(0, string(500, 'a' + i));
+    }
+    bool spilled = editor.getUndoSpillSize() > 0;
+    
+    // Old steps must not be replayed against the loaded document
+    bool load_ok = editor.loadFromFile("test_output.txt");
+    bool reset = (!editor.canUndo() && !editor.undo() && editor.getCurrentState() == 0 &&
+                  editor.getUndoSpillSize() == 0 && editor.getUndoMemoryUsage() == 0);
+    
+    editor.insert(0, "new ");
+    editor.undo();
+    
+    bool passed = (spilled && load_ok && reset && editor.getText() == "other file\n" &&
+                   !editor.canUndo());
+    test_result("File I/O - Loading a file starts a fresh undo history", passed);
+}
+
+void test_save_is_atomic() {
+    TextEditor editor;
+    editor.insert(0, string(100000, 'x'));
+    bool save_ok = editor.saveToFile("test_output.txt");
+    
+    // The temp file is renamed over the target, never left behind
+    ifstream temp("data/test_output.txt.tmp");
+    bool no_temp = !temp.is_open();
+    
+    // Saving into a missing directory fails without touching anything
+    bool bad_path_fails = !editor.saveToFile("data/no_such_dir/out.txt");
+    
+    bool passed = (save_ok && no_temp && bad_path_fails);
+    test_result("File I/O - Atomic save via temp file", passed);
+}
+
+// ============================================================================
+// TEST SUITE 7: Storage Backends
+// ============================================================================
+
+void test_piece_table_edits() {
+    TextBuffer buffer("Hello World", BufferBackend::PieceTable);
+    buffer.insert(5, ",");
+    buffer.insert(12, "!");
+    buffer.deleteText(0, 1);
+    buffer.insert(0, "J");
+    buffer.replace(7, 5, "Piece");
+    
+    bool passed = (buffer.getText() == "Jello, Piece!" &&
+                   buffer.length() == 13 &&
+                   buffer.getSubstring(3, 6) == "lo, Pi" &&
+                   buffer.getBackend() == BufferBackend::PieceTable);
+    test_result("PieceTable - Insert, delete and replace", passed);
+}
+
+void test_piece_table_editor_undo() {
+    TextEditor editor(BufferBackend::PieceTable);
+    editor.insert(0, "abc");
+    editor.insert(3, "def");
+    editor.deleteText(1, 4);
+    
+    bool delete_ok = (editor.getText() == "af");
+    
+    editor.undo();
+    editor.undo();
+    
+    bool passed = (delete_ok && editor.getText() == "abc");
+    test_result("PieceTable - Editor undo", passed);
+}
+
+void test_rope_edits() {
+    TextBuffer buffer(string(3000, 'a'), BufferBackend::Rope);
+    string expected(3000, 'a');
+    
+    // Mix in-leaf edits with ones that split and rejoin the tree
+    buffer.insert(1500, string(2000, 'b'));
+    expected.insert(1500, string(2000, 'b'));
+    buffer.insert(10, "xyz");
+    expected.insert(10, "xyz");
+    buffer.deleteText(1000, 2500);
+    expected.erase(1000, 2500);
+    buffer.replace(5, 3, "R");
+    expected.replace(5, 3, "R");
+    
+    bool passed = (buffer.getText() == expected &&
+                   buffer.getSubstring(995, 20) == expected.substr(995, 20));
+    test_result("Rope - Insert, delete and substring", passed);
+}
+
 // ============================================================================
 // MAIN TEST RUNNER
 // ============================================================================
@@ -371,6 +927,11 @@ int main() {
     cout << "-------------------------------------" << endl;
     test_buffer_large_text();
     test_buffer_chunk_rebalancing();
+    test_buffer_local_rebalancing();
+    test_buffer_indexed_lookup();
+    test_buffer_view_iteration();
+    test_buffer_line_index();
+    test_buffer_line_index_interleaved();
     cout << endl;
     
     cout << "SUITE 3: TextEditor Undo/Redo" << endl;
@@ -381,6 +942,13 @@ int main() {
     test_editor_multiple_undo();
     test_editor_undo_redo_sequence();
     test_editor_undo_clears_redo();
+    test_editor_coalesce_typing();
+    test_editor_undo_spill();
+    test_editor_undo_tree_branches();
+    test_editor_transaction();
+    test_editor_multi_edit();
+    test_editor_replace_all_undo();
+    test_stack_growth_and_reuse();
     cout << endl;
     
     cout << "SUITE 4: Edge Cases" << endl;
@@ -398,12 +966,24 @@ int main() {
     test_search_multiple_matches();
     test_search_no_match();
     test_search_overlapping_pattern();
+    test_search_simd_levels();
+    test_search_simd_ignore_case();
     test_search_and_replace();
     cout << endl;
     
     cout << "SUITE 6: File Operations" << endl;
     cout << "-------------------------------------" << endl;
     test_save_and_load();
+    test_load_then_edit();
+    test_load_resets_history();
+    test_save_is_atomic();
+    cout << endl;
+    
+    cout << "SUITE 7: Storage Backends" << endl;
+    cout << "-------------------------------------" << endl;
+    test_piece_table_edits();
+    test_piece_table_editor_undo();
+    test_rope_edits();
     cout << endl;
     
     cout << "=======================================" << endl;
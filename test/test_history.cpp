@@ -1,5 +1,5 @@
 // test_history.cpp - Unit tests for VersionHistory and VersionManager
-// Compile: g++ -o test_history test_history.cpp ../src/History.cpp ../src/Buffer.cpp -std=c++11 -I../src
+// Compile: g++ -o test_history test_history.cpp ../src/History.cpp ../src/Buffer.cpp ../src/PieceTable.cpp ../src/Rope.cpp ../src/MappedFile.cpp ../src/UndoSpill.cpp ../src/SimdScan.cpp ../src/TrigramIndex.cpp -std=c++11 -I../src
 // Run: ./test_history
 
 #include "../src/History.h"
@@ -1,11 +1,14 @@
 // test_search.cpp - Unit tests for AdvancedSearchEngine
-// Compile: g++ -o test_search test_search.cpp ../src/AdvancedSearch.cpp ../src/Buffer.cpp -std=c++11 -I../src
+// Compile: g++ -o test_search test_search.cpp ../src/AdvancedSearch.cpp ../src/RegexEngine.cpp ../src/SuffixArray.cpp ../src/ThreadPool.cpp ../src/Buffer.cpp ../src/PieceTable.cpp ../src/Rope.cpp ../src/MappedFile.cpp ../src/UndoSpill.cpp ../src/SimdScan.cpp ../src/TrigramIndex.cpp -std=c++11 -pthread -I../src
 // Run: ./test_search
 
 #include "../src/AdvancedSearch.h"
 #include <iostream>
 #include <cassert>
 #include <string>
+#include <memory>
+#include <cstdio>
+#include <ctime>
 
 using namespace std;
 
@@ -186,37 +189,325 @@ void test_search_with_context() {
     test_result("Advanced Search - With context", passed);
 }
 
+void test_search_buffer_line_column() {
+    AdvancedSearchEngine engine;
+    string text;
+    for (int i = 0; i < 1000; i++) {
+        text += "entry " + to_string(i) + (i % 100 == 0 ? " ERROR\n" : " ok\n");
+    }
+    TextBuffer buffer(text, BufferBackend::PieceTable);
+    buffer.insert(0, "header\n");
+    
+    SearchOptions opts;
+    opts.caseSensitive = false;
+    opts.wholeWord = true;
+    
+    vector<SearchResult> results = engine.search(buffer, "error", opts);
+    vector<SearchResult> expected = engine.search(buffer.getText(), "error", opts);
+    
+    bool passed = (results.size() == 10 && expected.size() == 10 &&
+                   results[3].line == 302 && results[3].column == 11 &&
+                   results[3].position == expected[3].position &&
+                   results[3].line == expected[3].line &&
+                   results[3].context == expected[3].context);
+    test_result("Advanced Search - Buffer line/column lookup", passed);
+}
+
+void test_search_regex() {
+    AdvancedSearchEngine engine;
+    string text = "id=42 name=x\nID=7\nid=  end id=1000";
+    
+    SearchOptions opts;
+    opts.useRegex = true;
+    opts.caseSensitive = false;
+    
+    vector<SearchResult> results = engine.search(text, "^id=[0-9]+", opts);
+    TextBuffer buffer(text, BufferBackend::Rope);
+    buffer.insert(0, "x\n");
+    vector<SearchResult> fromBuffer = engine.search(buffer, "[0-9]+$", opts);
+    
+    // Anchors are per line; matches are the longest from the leftmost start
+    bool passed = (results.size() == 2 &&
+                   results[0].position == 0 && results[0].length == 5 &&
+                   results[1].line == 2 && results[1].length == 4 &&
+                   fromBuffer.size() == 2 &&
+                   fromBuffer[0].line == 3 && fromBuffer[0].length == 1 &&
+                   fromBuffer[1].column == 13 && fromBuffer[1].length == 4);
+    test_result("Advanced Search - Regular expressions", passed);
+}
+
+void test_search_regex_invalid() {
+    AdvancedSearchEngine engine;
+    SearchOptions opts;
+    opts.useRegex = true;
+    
+    string error;
+    bool passed = (!engine.isValidRegex("(ab", &error) && !error.empty() &&
+                   engine.isValidRegex("a{2,3}|b*c") &&
+                   engine.search("abc", "[a-", opts).empty());
+    test_result("Advanced Search - Invalid regex rejected", passed);
+}
+
+void test_search_regex_long_line() {
+    string line;
+    while (line.length() < 100000) {
+        line += "ab ";
+    }
+    shared_ptr<Regex> regex = Regex::compile("ab|a.*c");
+    
+    // Every "a" starts an a.*c that runs to the end of the line without
+    // matching; rescanning it from each match was quadratic
+    clock_t begin = clock();
+    vector<Regex::Match> matches = regex->findAll(line);
+    double seconds = double(clock() - begin) / CLOCKS_PER_SEC;
+    vector<Regex::Match> closed = regex->findAll(line + "c\nab");
+    
+    bool passed = (matches.size() == line.length() / 3 && matches.back().position == line.length() - 3 &&
+                   matches.back().length == 2 && seconds < 2.0 &&
+                   closed.size() == 2 && closed[0].position == 0 && closed[0].length == line.length() + 1 &&
+                   closed[1].position == line.length() + 2);
+    test_result("Advanced Search - Regex on one long line stays linear", passed);
+}
+
+void test_search_find_previous() {
+    AdvancedSearchEngine engine;
+    string text;
+    for (int i = 0; i < 500; i++) {
+        text += (i % 50 == 0) ? "Needle in line\n" : "hay needles hay\n";
+    }
+    TextBuffer buffer(text, BufferBackend::Rope);
+    buffer.insert(20, "x");
+    
+    SearchOptions opts;
+    opts.caseSensitive = false;
+    opts.wholeWord = true;
+    
+    // Cursor sits on the match at line 451; the previous one is line 401
+    size_t cursor = buffer.getText().rfind("Needle");
+    SearchResult result(0, 0, 0, "");
+    bool found = engine.findPrevious(buffer, "needle", cursor, opts, result);
+    SearchResult first(0, 0, 0, "");
+    bool foundFirst = engine.findPrevious(buffer.getText(), "needle", 1, opts, first);
+    bool none = !engine.findPrevious(buffer, "needle", 0, opts, first);
+    
+    // Stepping back through a string with its line starts computed once
+    string copy = buffer.getText();
+    vector<size_t> lineStarts = engine.getLineStarts(copy);
+    SearchResult step(0, 0, 0, "");
+    bool stepped = engine.findPrevious(copy, "needle", cursor, opts, step, &lineStarts);
+    size_t steps = 1;
+    SearchResult earlier(0, 0, 0, "");
+    while (engine.findPrevious(copy, "needle", step.position, opts, earlier, &lineStarts)) {
+        stepped = stepped && earlier.line == step.line - 50;
+        step = earlier;
+        steps++;
+    }
+    stepped = stepped && steps == 9 && step.line == 1 && step.column == 1;
+    
+    opts.searchBackward = true;
+    vector<SearchResult> backward = engine.search(buffer, "needle", opts);
+    
+    bool passed = (found && result.line == 401 && result.column == 1 && result.length == 6 &&
+                   foundFirst && first.position == 0 && none && stepped &&
+                   backward.size() == 10 && backward[0].line == 451 && backward[9].line == 1);
+    test_result("Advanced Search - Find previous from cursor", passed);
+}
+
+void test_search_suffix_index() {
+    AdvancedSearchEngine engine;
+    string text;
+    for (int i = 0; i < 300; i++) {
+        text += "row " + to_string(i) + (i % 30 == 0 ? " abab ababab\n" : " plain\n");
+    }
+    TextBuffer buffer(text, BufferBackend::Rope);
+    
+    // Repeated searches of one version build the index
+    vector<size_t> scanned = engine.findAll(buffer, "abab");
+    bool builtEarly = engine.isIndexed(buffer);
+    for (int i = 0; i < 10; i++) {
+        engine.findAll(buffer, "plain");
+    }
+    bool indexed = engine.isIndexed(buffer);
+    vector<size_t> fromIndex = engine.findAll(buffer, "abab");
+    vector<SearchResult> results = engine.search(buffer, "row 29 ");
+    
+    // An edit makes it stale; results come from the new text
+    buffer.insert(0, "abab\n");
+    bool stale = !engine.isIndexed(buffer);
+    vector<size_t> afterEdit = engine.findAll(buffer, "abab");
+    
+    SuffixArray direct;
+    direct.build(string("banana"));
+    size_t repeatPos, repeatLen;
+    direct.longestRepeat(repeatPos, repeatLen);
+    
+    bool passed = (scanned.size() == 30 && !builtEarly && indexed &&
+                   fromIndex == scanned &&
+                   results.size() == 1 && results[0].line == 30 &&
+                   stale && afterEdit.size() == 31 && afterEdit[0] == 0 &&
+                   afterEdit[1] == scanned[0] + 5 &&
+                   direct.count("ana") == 2 && direct.find("a") == vector<size_t>({1, 3, 5}) &&
+                   repeatLen == 3 && repeatPos == 1);
+    test_result("Advanced Search - Suffix array index for repeated searches", passed);
+}
+
+void test_search_parallel() {
+    AdvancedSearchEngine engine;
+    engine.setIndexing(false);
+    string text;
+    for (int i = 0; text.length() < (3 << 20); i++) {
+        text += (i % 7 == 0) ? "Needle, needle_x NEEDLE\n" : "hay hay hay hay hay hay\n";
+    }
+    TextBuffer buffer(text, BufferBackend::Rope);  // many spans
+    
+    SearchOptions serial;
+    serial.caseSensitive = false;
+    serial.wholeWord = true;
+    SearchOptions parallel = serial;
+    parallel.threads = 4;
+    
+    vector<SearchResult> expected = engine.search(text, "needle", serial);
+    vector<SearchResult> fromString = engine.search(text, "needle", parallel);
+    vector<SearchResult> fromBuffer = engine.search(buffer, "needle", parallel);
+    
+    // Matches crossing the range cuts are found once
+    parallel.caseSensitive = true;
+    parallel.wholeWord = false;
+    vector<SearchResult> overlapping = engine.search(buffer, "hay hay", parallel);
+    serial.caseSensitive = true;
+    serial.wholeWord = false;
+    vector<SearchResult> overlappingSerial = engine.search(buffer, "hay hay", serial);
+    
+    bool same = (expected.size() > 10000 && fromString.size() == expected.size() &&
+                 fromBuffer.size() == expected.size() &&
+                 overlapping.size() == overlappingSerial.size());
+    for (size_t i = 0; same && i < expected.size(); i++) {
+        same = (fromString[i].position == expected[i].position &&
+                fromBuffer[i].position == expected[i].position &&
+                fromBuffer[i].line == expected[i].line && fromBuffer[i].column == expected[i].column &&
+                fromString[i].context == expected[i].context);
+    }
+    for (size_t i = 0; same && i < overlapping.size(); i++) {
+        same = (overlapping[i].position == overlappingSerial[i].position);
+    }
+    test_result("Advanced Search - Parallel search matches single-threaded", same);
+}
+
+void test_search_cursor() {
+    AdvancedSearchEngine engine;
+    string text;
+    for (int i = 0; i < 20000; i++) {
+        text += "the event was seen " + to_string(i) + "\n";
+    }
+    TextBuffer buffer(text, BufferBackend::Chunked);
+    
+    SearchOptions options;
+    vector<SearchResult> all = engine.search(buffer, "e", options);
+    
+    // Pages come out in order, without context until asked for
+    SearchCursor cursor = engine.openSearch(buffer, "e", options);
+    vector<SearchResult> first = cursor.nextPage(10);
+    vector<SearchResult> second = cursor.nextPage(10);
+    bool paged = (first.size() == 10 && second.size() == 10 && first[0].context.empty() &&
+                  cursor.getContext(first[3]) == all[3].context);
+    for (size_t i = 0; paged && i < 10; i++) {
+        paged = (first[i].position == all[i].position && second[i].position == all[10 + i].position &&
+                 second[i].line == all[10 + i].line && second[i].column == all[10 + i].column);
+    }
+    
+    // Backward, whole words, capped
+    options.searchBackward = true;
+    options.wholeWord = true;
+    options.maxResults = 3;
+    SearchCursor backward = engine.openSearch(buffer, "seen", options);
+    vector<SearchResult> last = backward.nextPage(10);
+    vector<SearchResult> capped = engine.search(buffer, "seen", options);
+    vector<SearchResult> cappedText = engine.search(text, "seen", options);
+    size_t lastSeen = text.rfind("seen");
+    
+    // An edit ends the cursor
+    buffer.insert(0, "e");
+    SearchResult result(0, 0, 0, "");
+    bool stopped = !cursor.isValid() && !cursor.next(result);
+    
+    bool passed = (paged && last.size() == 3 && last[0].position == lastSeen &&
+                   last[1].position < last[0].position && backward.getReturnedCount() == 3 &&
+                   capped.size() == 3 && capped[0].position == lastSeen && !capped[0].context.empty() &&
+                   cappedText.size() == 3 && cappedText[2].position == last[2].position && stopped);
+    test_result("Advanced Search - Lazy cursor with pages and result cap", passed);
+}
+
+void test_search_capped_string() {
+    AdvancedSearchEngine engine;
+    string text;
+    for (int i = 0; i < 30000; i++) {
+        text += (i % 7 == 0) ? "Token tokens\n" : "filler " + to_string(i) + " token\n";
+    }
+    
+    // Capped results match the head of the full list in both directions,
+    // including matches across the scan's block boundaries
+    bool passed = true;
+    for (int variant = 0; variant < 8; variant++) {
+        SearchOptions options;
+        options.searchBackward = (variant & 1) != 0;
+        options.wholeWord = (variant & 2) != 0;
+        options.caseSensitive = (variant & 4) != 0;
+        vector<SearchResult> all = engine.search(text, "token", options);
+        
+        options.maxResults = 5000;
+        vector<SearchResult> capped = engine.search(text, "token", options);
+        passed = passed && all.size() > 5000 && capped.size() == 5000;
+        for (size_t i = 0; passed && i < capped.size(); i++) {
+            passed = capped[i].position == all[i].position && capped[i].line == all[i].line &&
+                     capped[i].column == all[i].column && capped[i].context == all[i].context;
+        }
+    }
+    
+    SearchOptions regex;
+    regex.useRegex = true;
+    regex.searchBackward = true;
+    regex.maxResults = 2;
+    vector<SearchResult> last = engine.search(text, "fil+er [0-9]+", regex);
+    passed = passed && last.size() == 2 && last[0].line == 30000 && last[1].line == 29999;
+    
+    test_result("Advanced Search - Capped string search stops early", passed);
+}
+
 // ============================================================================
 // TEST SUITE 5: Replace Operations
 // ============================================================================
 
 void test_replace_first() {
-    AdvancedSearchEngine engine;
-    string text = "cat cat cat";
+    TextEditor editor;
+    editor.insert(0, "cat cat cat");
     
-    string result = engine.replaceFirst(text, "cat", "dog");
+    vector<size_t> positions = editor.search("cat");
+    editor.replace(positions[0], 3, "dog");
     
-    bool passed = (result == "dog cat cat");
+    bool passed = (editor.getText() == "dog cat cat");
     test_result("Replace - Replace first only", passed);
 }
 
 void test_replace_all() {
-    AdvancedSearchEngine engine;
-    string text = "cat cat cat";
+    TextEditor editor;
+    editor.insert(0, "cat cat cat");
     
-    string result = engine.replaceAll(text, "cat", "dog");
+    int count = editor.searchAndReplace("cat", "dog");
+    bool replaced = (count == 3 && editor.getText() == "dog dog dog");
     
-    bool passed = (result == "dog dog dog");
+    editor.undo();  // the whole replace is one undo step
+    
+    bool passed = (replaced && editor.getText() == "cat cat cat");
     test_result("Replace - Replace all occurrences", passed);
 }
 
 void test_replace_in_place() {
-    AdvancedSearchEngine engine;
+    SearchEngine engine;
     string text = "Hello World World";
     
-    int count = engine.replaceAllInPlace(text, "World", "C++");
+    vector<size_t> replaced = engine.searchAndReplace(text, "World", "C++");
     
-    bool passed = (count == 2 && text == "Hello C++ C++");
+    bool passed = (replaced.size() == 2 && text == "Hello C++ C++");
     test_result("Replace - In-place replacement", passed);
 }
 
@@ -281,6 +572,32 @@ void test_fuzzy_search() {
     test_result("Fuzzy Search - With tolerance", passed);
 }
 
+void test_fuzzy_search_results() {
+    AdvancedSearchEngine engine;
+    // Longer than 64 characters, so the matcher spans two words
+    string sentence = "the quick brown fox jumps over the lazy dog while the cat watches from the fence";
+    string typo = sentence;
+    typo.replace(typo.find("fox"), 3, "fax");
+    typo.erase(typo.find("lazy") + 1, 1);
+    
+    TextBuffer buffer("noise line\n" + typo + "\nmore noise\n", BufferBackend::PieceTable);
+    buffer.insert(0, "x");
+    
+    SearchOptions opts;
+    vector<SearchResult> results = engine.fuzzySearch(buffer, sentence, 3, opts);
+    vector<SearchResult> strict = engine.fuzzySearch(buffer, sentence, 1, opts);
+    
+    opts.caseSensitive = false;
+    vector<SearchResult> words = engine.fuzzySearch("Recieve, receive or RECEIVE", "receive", 2, opts);
+    
+    bool passed = (results.size() == 1 && results[0].line == 2 && results[0].column == 1 &&
+                   results[0].length == typo.length() && results[0].distance == 2 &&
+                   strict.empty() &&
+                   words.size() == 3 && words[0].distance == 2 && words[0].length == 7 &&
+                   words[1].distance == 0 && words[2].position == 20);
+    test_result("Fuzzy Search - Results with length and distance", passed);
+}
+
 // ============================================================================
 // TEST SUITE 7: Utility Functions
 // ============================================================================
@@ -289,7 +606,7 @@ void test_count_occurrences() {
     AdvancedSearchEngine engine;
     string text = "to be or not to be";
     
-    int count = engine.countOccurrences(text, "to");
+    size_t count = engine.search(text, "to").size();
     
     bool passed = (count == 2);
     test_result("Count Occurrences - Basic count", passed);
@@ -299,9 +616,14 @@ void test_find_with_context() {
     AdvancedSearchEngine engine;
     string text = "Line1\nLine2\nLine3 PATTERN here\nLine4\nLine5";
     
-    vector<SearchResult> results = engine.findWithContext(text, "PATTERN", 2);
+    SearchOptions opts;
+    opts.contextLines = 2;
     
-    bool passed = (results.size() == 1 && results[0].line == 3);
+    vector<SearchResult> results = engine.search(text, "PATTERN", opts);
+    
+    bool passed = (results.size() == 1 && results[0].line == 3 &&
+                   results[0].context.find("Line2") != string::npos &&
+                   results[0].context.find("Line4") != string::npos);
     test_result("Find with Context - Multi-line context", passed);
 }
 
@@ -320,6 +642,78 @@ void test_multi_pattern_search() {
     test_result("Multi-Pattern Search - Search multiple", passed);
 }
 
+void test_multi_pattern_tagged() {
+    AdvancedSearchEngine engine;
+    string text = "ERROR: disk full\nwarning: Errors ahead\nerror\n";
+    vector<string> patterns = {"error", "warn", "disk"};
+    
+    SearchOptions options;
+    options.caseSensitive = false;
+    options.wholeWord = true;
+    vector<SearchResult> results = engine.multiPatternSearch(text, patterns, options);
+    
+    // "Errors" and "warning" are not whole words
+    bool passed = (results.size() == 3 &&
+                   results[0].patternIndex == 0 && results[0].line == 1 &&
+                   results[1].patternIndex == 2 && results[1].column == 8 &&
+                   results[2].patternIndex == 0 && results[2].line == 3);
+    test_result("Multi-Pattern Search - Tagged results with options", passed);
+}
+
+static bool hasFile(const vector<FileSearchResult>& files, const string& path) {
+    for (const auto& file : files) {
+        if (file.path == path) return true;
+    }
+    return false;
+}
+
+void test_search_in_files() {
+    AdvancedSearchEngine engine;
+    TextEditor first, second;
+    first.insert(0, "alpha beta\ngamma Needle delta\n");
+    first.saveToFile("trigram_test_a.txt");
+    
+    // a is found by the scan in open(), b through the save hook
+    auto index = make_shared<TrigramIndex>("data");
+    bool opened = index->open();
+    first.setFileIndex(index);
+    second.setFileIndex(index);
+    second.insert(0, "needles and pins\n");
+    second.saveToFile("trigram_test_b.txt");
+    
+    // Trigrams are case-folded, so both are candidates; the search decides
+    vector<string> candidates = index->candidateFiles("Needle");
+    vector<FileSearchResult> exact = engine.searchFiles(*index, "Needle");
+    SearchOptions options;
+    options.caseSensitive = false;
+    vector<FileSearchResult> folded = engine.searchFiles(*index, "NEEDLE", options);
+    vector<string> scattered = index->candidateFiles("and alpha");  // trigrams present, not in order
+    
+    // Saving new contents re-indexes the file
+    first.replace(17, 6, "Thread");
+    first.saveToFile();
+    vector<FileSearchResult> afterSave = engine.searchFiles(*index, "Needle");
+    
+    // A second index replays the log
+    TrigramIndex reloaded("data");
+    reloaded.open();
+    vector<string> fromLog = reloaded.candidateFiles("Thread delta");
+    
+    remove("data/trigram_test_a.txt");
+    remove("data/trigram_test_b.txt");
+    index->refresh();
+    vector<string> afterRemove = index->candidateFiles("pins");
+    
+    bool passed = (opened && candidates.size() >= 2 &&
+                   exact.size() == 1 && exact[0].path == "data/trigram_test_a.txt" &&
+                   exact[0].results[0].line == 2 && exact[0].results[0].column == 7 &&
+                   hasFile(folded, "data/trigram_test_a.txt") && hasFile(folded, "data/trigram_test_b.txt") &&
+                   scattered.empty() && !hasFile(afterSave, "data/trigram_test_a.txt") &&
+                   fromLog.size() == 1 && fromLog[0] == "data/trigram_test_a.txt" &&
+                   afterRemove.empty());
+    test_result("Search in Files - Trigram index with verification", passed);
+}
+
 // ============================================================================
 // TEST SUITE 8: Search History
 // ============================================================================
@@ -419,6 +813,15 @@ int main() {
     test_search_case_sensitive();
     test_search_whole_word();
     test_search_with_context();
+    test_search_buffer_line_column();
+    test_search_regex();
+    test_search_regex_invalid();
+    test_search_regex_long_line();
+    test_search_find_previous();
+    test_search_suffix_index();
+    test_search_parallel();
+    test_search_cursor();
+    test_search_capped_string();
     cout << endl;
     
     cout << "SUITE 5: Replace Operations" << endl;
@@ -436,6 +839,7 @@ int main() {
     test_edit_distance_substitution();
     test_edit_distance_multiple();
     test_fuzzy_search();
+    test_fuzzy_search_results();
     cout << endl;
     
     cout << "SUITE 7: Utility Functions" << endl;
@@ -443,6 +847,8 @@ int main() {
     test_count_occurrences();
     test_find_with_context();
     test_multi_pattern_search();
+    test_multi_pattern_tagged();
+    test_search_in_files();
     cout << endl;
     
     cout << "SUITE 8: Search History" << endl;